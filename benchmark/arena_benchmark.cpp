@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <memory>
+#include <vector>
+#include "lua.hpp"
+#include "common/time.hpp"
+#include "common/arena.hpp"
+
+using namespace moon;
+
+/*
+    Many Lua states on one thread, the way services share a worker: every state builds
+    its objects in turns with the others, then each runs a full GC (walks all its objects)
+    and is closed.
+    malloc - lua_service's default allocator, all states interleave in the global heap
+    arena  - one arena per state, lua_close with the arena dropped
+*/
+
+static constexpr const char* workload = R"(
+    local n = ...
+    data = data or {}
+    for i = 1, n do
+        data[#data + 1] = { id = i, name = "item" .. i, pos = { x = i, y = i * 2 } }
+    end
+)";
+
+static void* malloc_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    (void)ud;
+    (void)osize;
+    if (nsize == 0)
+    {
+        free(ptr);
+        return nullptr;
+    }
+    return realloc(ptr, nsize);
+}
+
+static void* arena_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    return static_cast<arena*>(ud)->reallocate(ptr, osize, nsize);
+}
+
+struct run_state
+{
+    std::unique_ptr<arena> heap;
+    lua_State* L = nullptr;
+};
+
+struct cost
+{
+    int64_t build = 0;
+    int64_t gc = 0;
+    int64_t close = 0;
+};
+
+static cost run(size_t count, int rounds, int objects, bool use_arena)
+{
+    cost c;
+    std::vector<run_state> states(count);
+
+    int64_t start = time::microsecond();
+    for (auto& s : states)
+    {
+        if (use_arena)
+        {
+            s.heap = std::make_unique<arena>();
+            s.L = lua_newstate(arena_alloc, s.heap.get());
+        }
+        else
+        {
+            s.L = lua_newstate(malloc_alloc, nullptr);
+        }
+        luaL_openlibs(s.L);
+        if (luaL_loadstring(s.L, workload) != LUA_OK)
+        {
+            fprintf(stderr, "%s\n", lua_tostring(s.L, -1));
+            exit(1);
+        }
+        lua_setglobal(s.L, "workload");
+    }
+
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (auto& s : states)
+        {
+            lua_getglobal(s.L, "workload");
+            lua_pushinteger(s.L, objects);
+            lua_call(s.L, 1, 0);
+        }
+    }
+    c.build = time::microsecond() - start;
+
+    start = time::microsecond();
+    for (auto& s : states)
+    {
+        lua_gc(s.L, LUA_GCCOLLECT, 0);
+    }
+    c.gc = time::microsecond() - start;
+
+    start = time::microsecond();
+    for (auto& s : states)
+    {
+        if (s.heap)
+        {
+            s.heap->drop();
+        }
+        lua_close(s.L);
+        s.heap.reset();
+    }
+    c.close = time::microsecond() - start;
+    return c;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 1000;
+    int rounds = 20;
+    int objects = 50;
+
+    printf("arena benchmark: %zu states, %d rounds of %d objects each\n", count, rounds, objects);
+    for (int i = 0; i < 3; ++i)
+    {
+        for (bool use_arena : {false, true})
+        {
+            cost c = run(count, rounds, objects, use_arena);
+            printf("%-6s build %8.03fms, full gc %8.03fms, close %8.03fms\n",
+                use_arena ? "arena" : "malloc", c.build / 1000.0, c.gc / 1000.0, c.close / 1000.0);
+        }
+    }
+    return 0;
+}
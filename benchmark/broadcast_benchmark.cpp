@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "asio.hpp"
+#include "common/time.hpp"
+#include "common/byte_convert.hpp"
+#include "config.hpp"
+#include "network/const_buffers_holder.hpp"
+
+using namespace moon;
+
+/*
+    Broadcast small frames to many loopback connections, the write path of base_connection:
+    legacy    - flush as soon as the first frame is queued, one iovec per frame
+    coalesced - flush on the next event loop turn, small frames copied into const_buffers_holder's staging block
+    Receivers only count bytes, so the sender's write path dominates.
+    Needs about 2 * connections file descriptors.
+*/
+
+using tcp = asio::ip::tcp;
+
+static int64_t write_calls = 0;
+
+class sender : public std::enable_shared_from_this<sender>
+{
+public:
+    sender(tcp::socket&& s, bool coalesce)
+        :socket_(std::move(s))
+        , coalesce_(coalesce)
+    {
+    }
+
+    void send(const buffer_ptr_t& data)
+    {
+        queue_.emplace_back(data);
+        if (sending_)
+        {
+            return;
+        }
+
+        if (coalesce_)
+        {
+            sending_ = true;
+            asio::post(socket_.get_executor(), [this, self = shared_from_this()]() {
+                sending_ = false;
+                post_send();
+            });
+        }
+        else
+        {
+            post_send();
+        }
+    }
+private:
+    void post_send()
+    {
+        if (queue_.empty())
+        {
+            return;
+        }
+
+        for (const auto& buf : queue_)
+        {
+            if (coalesce_)
+            {
+                holder_.push_back(buf->data(), buf->size(), false);
+            }
+            else
+            {
+                legacy_.emplace_back(buf->data(), buf->size());
+            }
+
+            if ((coalesce_ ? holder_.size() : legacy_.size()) >= const_buffers_holder::max_count)
+            {
+                break;
+            }
+        }
+
+        ++write_calls;
+        sending_ = true;
+        auto done = [this, self = shared_from_this()](const asio::error_code& e, std::size_t) {
+            sending_ = false;
+            if (e)
+            {
+                return;
+            }
+            size_t n = coalesce_ ? holder_.count() : legacy_.size();
+            for (size_t i = 0; i < n; ++i)
+            {
+                queue_.pop_front();
+            }
+            holder_.clear();
+            legacy_.clear();
+            post_send();
+        };
+
+        if (coalesce_)
+        {
+            asio::async_write(socket_, make_buffers_ref(holder_.buffers()), std::move(done));
+        }
+        else
+        {
+            asio::async_write(socket_, make_buffers_ref(legacy_), std::move(done));
+        }
+    }
+private:
+    tcp::socket socket_;
+    bool coalesce_;
+    bool sending_ = false;
+    const_buffers_holder holder_;
+    std::vector<asio::const_buffer> legacy_;
+    std::deque<buffer_ptr_t> queue_;
+};
+
+class receiver : public std::enable_shared_from_this<receiver>
+{
+public:
+    receiver(tcp::socket&& s, size_t* received)
+        :socket_(std::move(s))
+        , received_(received)
+    {
+    }
+
+    void start()
+    {
+        socket_.async_read_some(asio::buffer(buf_, sizeof(buf_)), [this, self = shared_from_this()](const asio::error_code& e, std::size_t n) {
+            if (e)
+            {
+                return;
+            }
+            *received_ += n;
+            start();
+        });
+    }
+private:
+    tcp::socket socket_;
+    size_t* received_;
+    char buf_[16384];
+};
+
+static void run(bool coalesce, size_t connections, size_t frames, size_t rounds, size_t payload)
+{
+    asio::io_context ioc(1);
+    tcp::acceptor acceptor(ioc, tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    auto endpoint = acceptor.local_endpoint();
+
+    size_t received = 0;
+    std::vector<std::shared_ptr<sender>> senders;
+    std::vector<std::shared_ptr<receiver>> receivers;
+    for (size_t i = 0; i < connections; ++i)
+    {
+        tcp::socket client(ioc);
+        client.connect(endpoint);
+        tcp::socket server = acceptor.accept();
+        server.set_option(tcp::no_delay(true));
+        senders.emplace_back(std::make_shared<sender>(std::move(server), coalesce));
+        receivers.emplace_back(std::make_shared<receiver>(std::move(client), &received));
+        receivers.back()->start();
+    }
+
+    //moon_connection framing: 2 bytes length + payload
+    std::vector<buffer_ptr_t> frame_data;
+    for (size_t i = 0; i < frames * rounds; ++i)
+    {
+        auto buf = std::make_shared<buffer>(payload + sizeof(message_size_t), 0);
+        message_size_t size = static_cast<message_size_t>(payload);
+        host2net(size);
+        buf->write_back(&size, 1);
+        buf->write_back(std::string(payload, 'x').data(), payload);
+        frame_data.emplace_back(std::move(buf));
+    }
+
+    write_calls = 0;
+    size_t expect = connections * frames * rounds * (payload + sizeof(message_size_t));
+    int64_t start = time::microsecond();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        //one tick: every connection gets the same frames, then the event loop runs once
+        for (auto& s : senders)
+        {
+            for (size_t f = 0; f < frames; ++f)
+            {
+                s->send(frame_data[r * frames + f]);
+            }
+        }
+        ioc.poll();
+    }
+
+    while (received < expect)
+    {
+        ioc.run_one();
+    }
+    int64_t cost = time::microsecond() - start;
+
+    double total = static_cast<double>(connections * frames * rounds);
+    printf("%-10s %zu connections: %8.03fms, %12.02f frames/s, %8" PRId64 " writes, %.02f frames per write\n",
+        coalesce ? "coalesced" : "legacy", connections, cost / 1000.0, total * 1000000 / cost, write_calls, total / write_calls);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t connections = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 10000;
+    size_t frames = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 8;
+    size_t rounds = 20;
+    size_t payload = 32;
+    printf("broadcast benchmark: %zu frames of %zu bytes per tick, %zu ticks\n", frames, payload, rounds);
+    for (int i = 0; i < 2; ++i)
+    {
+        run(false, connections, frames, rounds, payload);
+        run(true, connections, frames, rounds, payload);
+    }
+    return 0;
+}
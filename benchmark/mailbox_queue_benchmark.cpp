@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common/time.hpp"
+#include "common/concurrent_queue.hpp"
+#include "common/mpsc_queue.hpp"
+#include "message.hpp"
+
+using namespace moon;
+
+/*
+    worker::send from many threads into one worker's mailbox, the worker thread drains it with swap:
+    concurrent_queue - the former mailbox, every push takes the queue's mutex
+    mpsc_queue       - intrusive lock-free mailbox, one CAS per push, one exchange per drain
+    Messages are created before the clock starts, so only push and drain are measured.
+    push is the time until the last producer finished, total until the consumer took the last message.
+    wakeups counts pushes that found the mailbox empty, each one posts a drain to the worker.
+*/
+
+using locked_queue = concurrent_queue<message_ptr_t, std::mutex, std::vector>;
+using lockfree_queue = mpsc_queue<message>;
+
+static bool push(locked_queue& q, message_ptr_t&& m)
+{
+    return q.push_back(std::move(m)) == 1;
+}
+
+static bool push(lockfree_queue& q, message_ptr_t&& m)
+{
+    return q.push_back(std::move(m));
+}
+
+template<typename Queue>
+static void run(const char* name, size_t producers, size_t messages)
+{
+    Queue q;
+    size_t per_producer = messages / producers;
+    size_t total = per_producer * producers;
+
+    std::vector<std::vector<message_ptr_t>> prepared(producers);
+    for (auto& v : prepared)
+    {
+        v.reserve(per_producer);
+        for (size_t i = 0; i < per_producer; ++i)
+        {
+            v.emplace_back(message::create(buffer_ptr_t{}));
+        }
+    }
+
+    std::atomic<bool> go = false;
+    std::atomic<int64_t> wakeups = 0;
+    std::atomic<int64_t> push_end = 0;
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&q, &go, &wakeups, &push_end, &v = prepared[p]] {
+            while (!go.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            int64_t n = 0;
+            for (auto& m : v)
+            {
+                if (push(q, std::move(m)))
+                {
+                    ++n;
+                }
+            }
+            wakeups.fetch_add(n, std::memory_order_relaxed);
+
+            int64_t end = time::microsecond();
+            int64_t last = push_end.load(std::memory_order_relaxed);
+            while (end > last && !push_end.compare_exchange_weak(last, end, std::memory_order_relaxed))
+            {
+            }
+        });
+    }
+
+    std::vector<message_ptr_t> batch;
+    size_t received = 0;
+    int64_t swaps = 0;
+    int64_t start = time::microsecond();
+    go.store(true, std::memory_order_release);
+    while (received < total)
+    {
+        q.swap(batch);
+        if (batch.empty())
+        {
+            continue;
+        }
+        ++swaps;
+        received += batch.size();
+        batch.clear();
+    }
+    int64_t cost = time::microsecond() - start;
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    int64_t push_cost = push_end.load() - start;
+    printf("%-16s %2zu producers: push %8.03fms, total %8.03fms, %12.02f msg/s, %8" PRId64 " wakeups, %.02f msg per drain\n",
+        name, producers, push_cost / 1000.0, cost / 1000.0, static_cast<double>(total) * 1000000 / cost, wakeups.load(), static_cast<double>(total) / swaps);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t messages = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 4000000;
+    printf("mailbox queue benchmark: %zu messages, one consumer\n", messages);
+    for (size_t producers : { 1, 4, 16, 64 })
+    {
+        run<locked_queue>("concurrent_queue", producers, messages);
+        run<lockfree_queue>("mpsc_queue", producers, messages);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <ctime>
+#include <functional>
+#include <random>
+#include <vector>
+#include "asio.hpp"
+#include "common/time.hpp"
+#include "common/timer.hpp"
+#include "common/histogram.hpp"
+
+using namespace moon;
+
+/*
+    Timer jitter and cost of the two worker timer modes:
+    tick    - worker::update every UPDATE_INTERVAL(10ms), timers see the time of the last update
+    precise - one asio::steady_timer armed for base_timer's nearest deadline
+    Jitter is how late a timer fires against its deadline on the steady clock.
+*/
+
+struct bench_timer
+{
+    int64_t deadline;
+    int64_t interval;
+};
+
+struct run_state
+{
+    std::vector<bench_timer> timers;
+    histogram jitter;
+    int64_t wakeups = 0;
+};
+
+struct jitter_policy
+{
+    jitter_policy(run_state* s, size_t index)
+        :state_(s)
+        , index_(index)
+    {
+    }
+
+    void operator()(moon::timer_t, bool)
+    {
+        auto& t = state_->timers[index_];
+        auto late = std::chrono::steady_clock::now() - time::steady_time(t.deadline);
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(late).count();
+        state_->jitter.record(static_cast<uint64_t>(std::max<int64_t>(us, 0)));
+        t.deadline += t.interval;
+    }
+
+    run_state* state_;
+    size_t index_;
+};
+
+using timer_type = base_timer<jitter_policy>;
+
+static void arm(asio::steady_timer& kt, timer_type& timer, run_state& st, int64_t& armed)
+{
+    int64_t next = timer.next_expiretime();
+    if (next == std::numeric_limits<int64_t>::max() || (armed != 0 && armed <= next))
+    {
+        return;
+    }
+    armed = next;
+    kt.expires_at(time::steady_time(next));
+    kt.async_wait([&kt, &timer, &st, &armed](const asio::error_code& e) {
+        if (e)
+        {
+            return;
+        }
+        ++st.wakeups;
+        armed = 0;
+        timer.update(time::now());
+        arm(kt, timer, st, armed);
+    });
+}
+
+static void run(bool precise, size_t count, int64_t duration)
+{
+    asio::io_context ioc(1);
+    run_state st;
+    timer_type timer;
+    std::mt19937 rng(20210101);
+    std::uniform_int_distribution<int64_t> interval(10, 1000);
+
+    //tick mode starts timers at the last update time, like server::now()
+    int64_t now = time::now();
+    st.timers.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int64_t v = interval(rng);
+        st.timers.emplace_back(bench_timer{ now + v, v });
+        timer.repeat(now, v, -1, &st, i);
+    }
+
+    asio::steady_timer kt(ioc);
+    int64_t armed = 0;
+    std::function<void()> tick;
+    if (precise)
+    {
+        arm(kt, timer, st, armed);
+    }
+    else
+    {
+        tick = [&]() {
+            kt.expires_after(std::chrono::milliseconds(10));
+            kt.async_wait([&](const asio::error_code& e) {
+                if (e)
+                {
+                    return;
+                }
+                ++st.wakeups;
+                timer.update(time::now());
+                tick();
+            });
+        };
+        tick();
+    }
+
+    std::clock_t cpu = std::clock();
+    ioc.run_for(std::chrono::milliseconds(duration));
+    double cpu_ms = static_cast<double>(std::clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+
+    printf("%-8s timers %6zu: fired %8" PRIu64 ", jitter p50 %6" PRIu64 "us p99 %6" PRIu64 "us max %6" PRIu64 "us, wakeups %6" PRId64 ", cpu %8.02fms\n",
+        precise ? "precise" : "tick", count, st.jitter.count(), st.jitter.percentile(50), st.jitter.percentile(99), st.jitter.max(), st.wakeups, cpu_ms);
+}
+
+int main(int argc, char* argv[])
+{
+    int64_t duration = argc > 1 ? std::atoll(argv[1]) : 3000;
+    printf("precise timer benchmark: %" PRId64 "ms per run, intervals 10-1000ms\n", duration);
+    for (size_t count : {0, 1000, 100000})
+    {
+        run(false, count, duration);
+        run(true, count, duration);
+    }
+    return 0;
+}
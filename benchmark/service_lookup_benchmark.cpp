@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "common/time.hpp"
+#include "common/slot_table.hpp"
+
+using namespace moon;
+
+/*
+    worker::find_service for every message of a drain loop: 10k services on one worker,
+    receivers in random order so the previous-receiver shortcut never hits.
+    unordered_map - the former services_ lookup
+    slot_table    - slot indexed by the low 16 bits of the id, plus a few stolen services in its map
+*/
+
+struct fake_service
+{
+    uint32_t id;
+    int64_t handled = 0;
+};
+
+static constexpr uint32_t WORKER_ID = 1;
+
+template<typename Find>
+static int64_t route(const std::vector<uint32_t>& receivers, Find&& find, int64_t& cost)
+{
+    int64_t dead = 0;
+    int64_t start = time::microsecond();
+    for (auto id : receivers)
+    {
+        if (auto s = find(id); nullptr != s)
+        {
+            ++s->handled;
+        }
+        else
+        {
+            ++dead;
+        }
+    }
+    cost = time::microsecond() - start;
+    return dead;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t count = argc > 1 ? static_cast<size_t>(std::atoi(argv[1])) : 10000;
+    size_t messages = 10000000;
+    std::mt19937 rng(20210101);
+
+    std::vector<std::unique_ptr<fake_service>> services;
+    std::unordered_map<uint32_t, fake_service*> map;
+    slot_table<fake_service> table(WORKER_ID);
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < count; ++i)
+    {
+        //every 100th service was stolen from worker 2
+        uint32_t wid = (i % 100 == 99) ? 2 : WORKER_ID;
+        uint32_t id = (wid << 24) | static_cast<uint32_t>(i + 1);
+        auto& s = services.emplace_back(std::make_unique<fake_service>());
+        s->id = id;
+        map.emplace(id, s.get());
+        table.insert(id, s.get());
+        ids.emplace_back(id);
+    }
+
+    //1% of the messages go to services that already exited
+    std::uniform_int_distribution<size_t> pick(0, ids.size() - 1);
+    std::vector<uint32_t> receivers;
+    receivers.reserve(messages);
+    for (size_t i = 0; i < messages; ++i)
+    {
+        uint32_t id = ids[pick(rng)];
+        receivers.emplace_back(i % 100 == 0 ? (WORKER_ID << 24) | 0xFFFF : id);
+    }
+
+    printf("service lookup benchmark: %zu services, %zu messages\n", count, messages);
+    for (int round = 0; round < 3; ++round)
+    {
+        int64_t map_cost = 0;
+        int64_t map_dead = route(receivers, [&map](uint32_t id) -> fake_service* {
+            auto iter = map.find(id);
+            return iter != map.end() ? iter->second : nullptr;
+            }, map_cost);
+
+        int64_t table_cost = 0;
+        int64_t table_dead = route(receivers, [&table](uint32_t id) {
+            return table.find(id);
+            }, table_cost);
+
+        printf("unordered_map %8.03fms %6.02fns/msg, slot_table %8.03fms %6.02fns/msg, dead %" PRId64 "/%" PRId64 "\n",
+            map_cost / 1000.0, map_cost * 1000.0 / messages,
+            table_cost / 1000.0, table_cost * 1000.0 / messages,
+            map_dead, table_dead);
+
+        if (map_dead != table_dead)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+--[[
+    Service spawn rate: create services the way one player session is created,
+    one after another, each waiting for the previous init to finish. Then the same with
+    states taken from a warmed moon.vm_pool.
+    run: ./moon -f benchmark/spawn_benchmark.lua
+]]
+local moon = require("moon")
+
+local conf = ...
+
+if conf.session then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        moon.response("lua", sender, sessionid, unpack(sz, len))
+    end)
+    moon.shutdown(function()
+        moon.quit()
+    end)
+    return
+end
+
+local count = 2000
+
+local function spawn(round, n, vmpool)
+    local services = {}
+    local start = moon.now()
+    for i = 1, n do
+        services[i] = moon.new_service("lua", {
+            name = "session",
+            file = "spawn_benchmark.lua",
+            session = true,
+            uid = i,
+            vmpool = vmpool,
+        })
+    end
+    local cost = (moon.now() - start) / 1000
+    print(string.format("%s round %d: %d services %.03fs, %.0f services/s, %.01fus/service",
+        vmpool or "fresh", round, n, cost, n / cost, cost * 1000000 / n))
+
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+end
+
+moon.async(function()
+    for round = 1, 3 do
+        spawn(round, count, nil)
+        moon.sleep(100)
+    end
+
+    --- bursts no larger than the pool, the worker refills it while idle between bursts
+    local burst = 1000
+    moon.vm_pool("session", burst, 0, {"base.set", "base.array"})
+    moon.sleep(1000)
+    for round = 1, 3 do
+        spawn(round, burst, "session")
+        moon.sleep(1000)
+    end
+    moon.exit(-1)
+end)
+
+moon.shutdown(function()
+    moon.quit()
+end)
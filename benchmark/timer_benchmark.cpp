@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cinttypes>
+#include <random>
+#include <vector>
+#include "common/time.hpp"
+#include "common/timer.hpp"
+
+using namespace moon;
+
+/*
+    base_timer<ordered_timer_queue> (std::multimap) vs base_timer<timing_wheel>.
+    Workload mirrors scene services: many short repeating timers (AI ticks, buffs),
+    worker::update every 10ms, and a share of timers cancelled before they expire.
+    Both queues must fire every timer in the same update: the checksum sums (timer id, update time) of each fire.
+*/
+
+struct result
+{
+    int64_t repeat_cost = 0;
+    int64_t update_cost = 0;
+    int64_t remove_cost = 0;
+    int64_t fired = 0;
+    uint64_t checksum = 0;
+    //time of the running update
+    int64_t now = 0;
+};
+
+struct count_policy
+{
+    explicit count_policy(result* res)
+        :res_(res)
+    {
+    }
+
+    void operator()(moon::timer_t id, bool)
+    {
+        ++res_->fired;
+        //order of the fires within one update may differ, the sum does not
+        uint64_t x = (static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ull) ^ static_cast<uint64_t>(res_->now);
+        x ^= x >> 31;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 29;
+        res_->checksum += x;
+    }
+
+    result* res_;
+};
+
+template<template<typename> class TimerQueue>
+static result run(int64_t now, size_t count, int64_t duration)
+{
+    result res;
+    base_timer<count_policy, TimerQueue> timer;
+    std::mt19937 rng(20210101);
+    std::uniform_int_distribution<int64_t> interval(10, 1000);
+
+    std::vector<moon::timer_t> ids;
+    ids.reserve(count);
+
+    int64_t start = time::microsecond();
+    for (size_t i = 0; i < count; ++i)
+    {
+        ids.emplace_back(timer.repeat(now, interval(rng), -1, &res));
+    }
+    res.repeat_cost = time::microsecond() - start;
+
+    start = time::microsecond();
+    for (int64_t t = 10; t <= duration; t += 10)
+    {
+        res.now = now + t;
+        timer.update(res.now);
+    }
+    res.update_cost = time::microsecond() - start;
+
+    //cancel every other timer, then the rest
+    start = time::microsecond();
+    for (size_t i = 0; i < ids.size(); i += 2)
+    {
+        timer.remove(ids[i]);
+    }
+    for (size_t i = 1; i < ids.size(); i += 2)
+    {
+        timer.remove(ids[i]);
+    }
+    res.remove_cost = time::microsecond() - start;
+    return res;
+}
+
+static void print(const char* name, size_t count, const result& res)
+{
+    printf("%-14s timers %7zu: repeat %8.03fms, update %9.03fms, remove %8.03fms, fired %" PRId64 "\n",
+        name, count, res.repeat_cost / 1000.0, res.update_cost / 1000.0, res.remove_cost / 1000.0, res.fired);
+}
+
+int main()
+{
+    const int64_t duration = 10000;
+    printf("timer benchmark: simulate %" PRId64 "ms, update every 10ms\n", duration);
+    //a multiple of 10 and 256: updates land on near wheel boundaries now and then
+    const int64_t now = time::now() / 1280 * 1280;
+    for (size_t count : {1000, 10000, 100000})
+    {
+        auto ordered = run<ordered_timer_queue>(now, count, duration);
+        auto wheel = run<timing_wheel>(now, count, duration);
+        print("multimap", count, ordered);
+        print("timing_wheel", count, wheel);
+        if (ordered.fired != wheel.fired || ordered.checksum != wheel.checksum)
+        {
+            printf("mismatch: multimap fired %" PRId64 ", timing_wheel fired %" PRId64 ", fire times %s\n",
+                ordered.fired, wheel.fired, ordered.checksum == wheel.checksum ? "equal" : "differ");
+            return 1;
+        }
+    }
+    return 0;
+}
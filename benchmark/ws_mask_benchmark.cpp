@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <cinttypes>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "common/time.hpp"
+#include "common/ws_mask.hpp"
+
+using namespace moon;
+
+/*
+    Unmasking websocket payloads of typical frame sizes, about 64MB of payload per size:
+    bytewise - the former loop of ws_connection, d[i] ^ key[i % 4]
+    ws_mask  - common/ws_mask.hpp, AVX2 or SSE2 when the build enables them, 8 bytes a word otherwise
+    Payloads start at odd offsets, as they do behind a 2, 4, 8 or 14 byte frame header.
+*/
+
+static constexpr size_t TOTAL_BYTES = 64 * 1024 * 1024;
+
+static void bytewise(uint8_t* d, size_t len, const uint8_t* key)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        d[i] = d[i] ^ key[i % 4];
+    }
+}
+
+template<typename Mask>
+static int64_t run(std::vector<uint8_t>& data, size_t size, const uint8_t* key, Mask&& mask)
+{
+    size_t frames = TOTAL_BYTES / size;
+    size_t offset = 6;
+    int64_t start = time::microsecond();
+    for (size_t i = 0; i < frames; ++i)
+    {
+        mask(data.data() + offset, size, key);
+    }
+    return time::microsecond() - start;
+}
+
+int main(int argc, char* argv[])
+{
+    (void)argc;
+    (void)argv;
+    const size_t sizes[] = { 16, 64, 125, 512, 1500, 4096, 16384, 65535 };
+    const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+#if defined(MOON_WS_MASK_AVX2)
+    printf("ws mask benchmark: AVX2\n");
+#elif defined(MOON_WS_MASK_SSE2)
+    printf("ws mask benchmark: SSE2\n");
+#else
+    printf("ws mask benchmark: scalar\n");
+#endif
+
+    std::mt19937 rng(20210101);
+    std::vector<uint8_t> data(65535 + 64);
+    for (auto& c : data)
+    {
+        c = static_cast<uint8_t>(rng());
+    }
+
+    //both must give the same bytes, and masking twice must give the payload back
+    for (size_t len = 0; len < 200; ++len)
+    {
+        std::vector<uint8_t> a(data.begin() + 3, data.begin() + 3 + len);
+        std::vector<uint8_t> b = a;
+        bytewise(a.data(), len, key);
+        ws_mask(b.data(), len, key);
+        if (a != b)
+        {
+            printf("ws_mask mismatch at len %zu\n", len);
+            return 1;
+        }
+        ws_mask(b.data(), len, key);
+        if (!std::equal(b.begin(), b.end(), data.begin() + 3))
+        {
+            printf("ws_mask roundtrip failed at len %zu\n", len);
+            return 1;
+        }
+    }
+
+    for (auto size : sizes)
+    {
+        int64_t bytewise_cost = run(data, size, key, bytewise);
+        int64_t mask_cost = run(data, size, key, ws_mask);
+        size_t frames = TOTAL_BYTES / size;
+        printf("%6zu bytes: bytewise %8.03fms %8.02fns/frame %7.02fGB/s, ws_mask %8.03fms %8.02fns/frame %7.02fGB/s\n",
+            size,
+            bytewise_cost / 1000.0, bytewise_cost * 1000.0 / frames, (frames * size) / (bytewise_cost * 1000.0),
+            mask_cost / 1000.0, mask_cost * 1000.0 / frames, (frames * size) / (mask_cost * 1000.0));
+    }
+    return 0;
+}
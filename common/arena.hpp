@@ -0,0 +1,229 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace moon
+{
+    /*
+        Size class heap owned by one lua_State, driven through lua_Alloc (callers pass the old
+        size, so small blocks need no header).
+        Blocks up to MAX_SMALL bytes are carved from CHUNK_SIZE chunks, one free list per 16 bytes
+        size class: objects of one state stay close together instead of interleaving with every
+        other state's objects in the global heap. Larger blocks come from malloc with a header
+        that links them, so the arena can release them without the state's help.
+        Shrinking a small block keeps it in place: a block larger than its size class is fine on
+        a free list, and the allocator must not fail when shrinking.
+        drop() turns frees into no-ops for lua_close: the state still runs its finalizers, but
+        the object sweep no longer touches the heap, the destructor releases the chunks at once.
+        Not thread safe: used by one thread at a time, like its state.
+    */
+    class arena
+    {
+        static constexpr size_t ALIGN = 16;
+        static constexpr size_t MAX_SMALL = 512;
+        static constexpr size_t CLASS_COUNT = MAX_SMALL / ALIGN;
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+        struct free_block
+        {
+            free_block* next;
+        };
+
+        //keeps the pointer after it ALIGN aligned
+        struct alignas(ALIGN) large_block
+        {
+            large_block* prev;
+            large_block* next;
+            size_t size;
+        };
+    public:
+        arena()
+        {
+            large_.prev = &large_;
+            large_.next = &large_;
+        }
+
+        arena(const arena&) = delete;
+
+        arena& operator=(const arena&) = delete;
+
+        ~arena()
+        {
+            for (large_block* b = large_.next; b != &large_;)
+            {
+                large_block* next = b->next;
+                std::free(b);
+                b = next;
+            }
+
+            for (void* chunk : chunks_)
+            {
+                std::free(chunk);
+            }
+        }
+
+        //lua_Alloc semantics: osize is the block size when ptr is not null
+        void* reallocate(void* ptr, size_t osize, size_t nsize)
+        {
+            if (nullptr == ptr)
+            {
+                return (0 == nsize) ? nullptr : allocate(nsize);
+            }
+
+            if (0 == nsize)
+            {
+                deallocate(ptr, osize);
+                return nullptr;
+            }
+
+            if (osize <= MAX_SMALL)
+            {
+                if (nsize <= osize || class_index(nsize) == class_index(osize))
+                {
+                    return ptr;
+                }
+                return move(ptr, osize, nsize);
+            }
+
+            if (nsize <= MAX_SMALL)
+            {
+                void* p = move(ptr, osize, nsize);
+                return (nullptr != p) ? p : ptr;
+            }
+
+            large_block* b = header(ptr);
+            unlink(b);
+            large_block* nb = static_cast<large_block*>(std::realloc(b, sizeof(large_block) + nsize));
+            if (nullptr == nb)
+            {
+                link(b);
+                return (nsize <= osize) ? ptr : nullptr;
+            }
+            reserved_ += nsize;
+            reserved_ -= nb->size;
+            nb->size = nsize;
+            link(nb);
+            return nb + 1;
+        }
+
+        void drop()
+        {
+            dropped_ = true;
+        }
+
+        //bytes taken from the system
+        size_t reserved() const
+        {
+            return reserved_;
+        }
+    private:
+        static size_t class_index(size_t size)
+        {
+            return (size + ALIGN - 1) / ALIGN - 1;
+        }
+
+        static large_block* header(void* ptr)
+        {
+            return static_cast<large_block*>(ptr) - 1;
+        }
+
+        void link(large_block* b)
+        {
+            b->prev = &large_;
+            b->next = large_.next;
+            large_.next->prev = b;
+            large_.next = b;
+        }
+
+        static void unlink(large_block* b)
+        {
+            b->prev->next = b->next;
+            b->next->prev = b->prev;
+        }
+
+        void* move(void* ptr, size_t osize, size_t nsize)
+        {
+            void* p = allocate(nsize);
+            if (nullptr != p)
+            {
+                std::memcpy(p, ptr, (osize < nsize) ? osize : nsize);
+                deallocate(ptr, osize);
+            }
+            return p;
+        }
+
+        void* allocate(size_t size)
+        {
+            if (size > MAX_SMALL)
+            {
+                large_block* b = static_cast<large_block*>(std::malloc(sizeof(large_block) + size));
+                if (nullptr == b)
+                {
+                    return nullptr;
+                }
+                b->size = size;
+                link(b);
+                reserved_ += size;
+                return b + 1;
+            }
+
+            size_t index = class_index(size);
+            if (free_block* b = free_[index]; nullptr != b)
+            {
+                free_[index] = b->next;
+                return b;
+            }
+
+            size_t bytes = (index + 1) * ALIGN;
+            if (static_cast<size_t>(end_ - cur_) < bytes)
+            {
+                //the tail of the old chunk is lost, at most MAX_SMALL bytes
+                char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+                if (nullptr == chunk)
+                {
+                    return nullptr;
+                }
+                chunks_.emplace_back(chunk);
+                reserved_ += CHUNK_SIZE;
+                cur_ = chunk;
+                end_ = chunk + CHUNK_SIZE;
+            }
+            void* p = cur_;
+            cur_ += bytes;
+            return p;
+        }
+
+        void deallocate(void* ptr, size_t size)
+        {
+            if (dropped_)
+            {
+                return;
+            }
+
+            if (size > MAX_SMALL)
+            {
+                large_block* b = header(ptr);
+                unlink(b);
+                reserved_ -= b->size;
+                std::free(b);
+                return;
+            }
+
+            size_t index = class_index(size);
+            free_block* b = static_cast<free_block*>(ptr);
+            b->next = free_[index];
+            free_[index] = b;
+        }
+    private:
+        bool dropped_ = false;
+        char* cur_ = nullptr;
+        char* end_ = nullptr;
+        size_t reserved_ = 0;
+        free_block* free_[CLASS_COUNT] = {};
+        large_block large_;
+        std::vector<void*> chunks_;
+    };
+}
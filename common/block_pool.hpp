@@ -0,0 +1,205 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "spinlock.hpp"
+
+namespace moon
+{
+    /*
+        Fixed size block allocator with a free list per thread.
+        Messages are usually created on the sender's thread and freed on the receiver's,
+        so a thread whose free list grows too long moves a batch of blocks to a shared depot,
+        and a thread that runs dry takes one batch back: one lock per BATCH blocks.
+    */
+    template<size_t BlockSize>
+    class block_pool
+    {
+        struct block
+        {
+            block* next;
+        };
+
+        static_assert(BlockSize >= sizeof(block), "block size too small");
+
+        static constexpr size_t BATCH = 256;
+        //batches kept in the depot, beyond that blocks go back to the system
+        static constexpr size_t MAX_DEPOT = 256;
+
+        struct batch
+        {
+            block* head;
+            size_t count;
+        };
+
+        struct depot
+        {
+            spin_lock lock;
+            std::vector<batch> batches;
+        };
+
+        //trivially destructible: blocks cached by an exiting thread are not reclaimed
+        struct cache
+        {
+            block* head;
+            size_t count;
+        };
+    public:
+        static void* allocate()
+        {
+            cache& c = cache_;
+            if (nullptr == c.head)
+            {
+                refill(c);
+            }
+
+            if (block* b = c.head; nullptr != b)
+            {
+                c.head = b->next;
+                --c.count;
+                return b;
+            }
+
+            allocated_.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(BlockSize);
+        }
+
+        static void deallocate(void* p)
+        {
+            if (nullptr == p)
+            {
+                return;
+            }
+
+            cache& c = cache_;
+            block* b = static_cast<block*>(p);
+            b->next = c.head;
+            c.head = b;
+            if (++c.count >= 2 * BATCH)
+            {
+                flush(c);
+            }
+        }
+
+        //blocks requested from the system so far
+        static size_t allocated()
+        {
+            return allocated_.load(std::memory_order_relaxed);
+        }
+    private:
+        static depot& get_depot()
+        {
+            //never destroyed, blocks may be freed during static destruction
+            static depot* d = new depot();
+            return *d;
+        }
+
+        static void refill(cache& c)
+        {
+            depot& d = get_depot();
+            std::lock_guard lock(d.lock);
+            if (!d.batches.empty())
+            {
+                batch& b = d.batches.back();
+                c.head = b.head;
+                c.count = b.count;
+                d.batches.pop_back();
+            }
+        }
+
+        static void flush(cache& c)
+        {
+            block* head = c.head;
+            block* tail = head;
+            for (size_t i = 1; i < BATCH; ++i)
+            {
+                tail = tail->next;
+            }
+            c.head = tail->next;
+            c.count -= BATCH;
+            tail->next = nullptr;
+
+            {
+                depot& d = get_depot();
+                std::lock_guard lock(d.lock);
+                if (d.batches.size() < MAX_DEPOT)
+                {
+                    d.batches.emplace_back(batch{ head, BATCH });
+                    return;
+                }
+            }
+
+            while (nullptr != head)
+            {
+                block* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    private:
+        static inline thread_local cache cache_{ nullptr, 0 };
+        static inline std::atomic<size_t> allocated_{ 0 };
+    };
+
+    //power of two size classes up to MAX_SIZE use block_pool, larger requests use operator new
+    template<typename T>
+    class pool_allocator
+    {
+        static constexpr size_t MAX_SIZE = 1024;
+    public:
+        using value_type = T;
+
+        pool_allocator() noexcept = default;
+
+        template<typename U>
+        pool_allocator(const pool_allocator<U>&) noexcept {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(allocate_bytes(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n) noexcept
+        {
+            deallocate_bytes(p, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator==(const pool_allocator<U>&) const noexcept { return true; }
+
+        template<typename U>
+        bool operator!=(const pool_allocator<U>&) const noexcept { return false; }
+
+        //blocks requested from the system by all size classes
+        static size_t allocated()
+        {
+            return block_pool<32>::allocated() + block_pool<64>::allocated() + block_pool<128>::allocated()
+                + block_pool<256>::allocated() + block_pool<512>::allocated() + block_pool<1024>::allocated();
+        }
+    private:
+        static void* allocate_bytes(size_t size)
+        {
+            if (size <= 32) return block_pool<32>::allocate();
+            if (size <= 64) return block_pool<64>::allocate();
+            if (size <= 128) return block_pool<128>::allocate();
+            if (size <= 256) return block_pool<256>::allocate();
+            if (size <= 512) return block_pool<512>::allocate();
+            if (size <= MAX_SIZE) return block_pool<1024>::allocate();
+            return ::operator new(size);
+        }
+
+        static void deallocate_bytes(void* p, size_t size) noexcept
+        {
+            if (size <= 32) return block_pool<32>::deallocate(p);
+            if (size <= 64) return block_pool<64>::deallocate(p);
+            if (size <= 128) return block_pool<128>::deallocate(p);
+            if (size <= 256) return block_pool<256>::deallocate(p);
+            if (size <= 512) return block_pool<512>::deallocate(p);
+            if (size <= MAX_SIZE) return block_pool<1024>::deallocate(p);
+            ::operator delete(p);
+        }
+    };
+}
@@ -453,9 +453,10 @@ namespace moon
     using buffer = base_buffer<mi_stl_allocator<char>>;
 }
 #else
+#include "block_pool.hpp"
 namespace moon
 {
-    using buffer = base_buffer<std::allocator<char>>;
+    using buffer = base_buffer<pool_allocator<char>>;
 }
 #endif
 
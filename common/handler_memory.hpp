@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include "noncopyable.hpp"
+
+namespace moon
+{
+    /*
+        Storage for one asio handler that is posted over and over, so that posting it
+        does not go through the heap. A second handler allocated while the slot is taken
+        falls back to operator new.
+    */
+    class handler_memory : public moon::noncopyable
+    {
+    public:
+        static constexpr size_t SLOT_SIZE = 128;
+
+        void* allocate(size_t size)
+        {
+            if (size <= SLOT_SIZE && !in_use_.exchange(true, std::memory_order_acquire))
+            {
+                return &storage_;
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void* p)
+        {
+            if (p == &storage_)
+            {
+                in_use_.store(false, std::memory_order_release);
+                return;
+            }
+            ::operator delete(p);
+        }
+    private:
+        std::aligned_storage_t<SLOT_SIZE> storage_;
+        std::atomic_bool in_use_ = false;
+    };
+
+    //allocator handed to asio through the handler's get_allocator()
+    template<typename T>
+    class handler_allocator
+    {
+        template<typename>
+        friend class handler_allocator;
+    public:
+        using value_type = T;
+
+        explicit handler_allocator(handler_memory* mem)
+            :memory_(mem)
+        {
+        }
+
+        template<typename U>
+        handler_allocator(const handler_allocator<U>& other) noexcept
+            :memory_(other.memory_)
+        {
+        }
+
+        T* allocate(size_t n) const
+        {
+            return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+        }
+
+        void deallocate(T* p, size_t) const
+        {
+            memory_->deallocate(p);
+        }
+
+        bool operator==(const handler_allocator& other) const noexcept
+        {
+            return memory_ == other.memory_;
+        }
+
+        bool operator!=(const handler_allocator& other) const noexcept
+        {
+            return memory_ != other.memory_;
+        }
+    private:
+        handler_memory* memory_;
+    };
+}
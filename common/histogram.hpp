@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace moon
+{
+    /*
+        Log-linear histogram in the style of HdrHistogram.
+        Values below SUB_COUNT are counted exactly, above that every power of two
+        is split into SUB_COUNT buckets, so any recorded value is reported within 1/SUB_COUNT.
+        Buckets grow on demand: small latencies only need a few hundred bytes.
+    */
+    class histogram
+    {
+        static constexpr uint32_t SUB_BITS = 4;
+        static constexpr uint64_t SUB_COUNT = uint64_t{ 1 } << SUB_BITS;
+        //larger values are clamped, about 12 days in microseconds
+        static constexpr uint64_t MAX_VALUE = (uint64_t{ 1 } << 40) - 1;
+    public:
+        void record(uint64_t v)
+        {
+            v = std::min(v, MAX_VALUE);
+            size_t index = bucket_index(v);
+            if (index >= counts_.size())
+            {
+                counts_.resize(index + 1, 0);
+            }
+            ++counts_[index];
+            ++count_;
+            sum_ += v;
+            max_ = std::max(max_, v);
+        }
+
+        void merge(const histogram& other)
+        {
+            if (other.counts_.size() > counts_.size())
+            {
+                counts_.resize(other.counts_.size(), 0);
+            }
+            for (size_t i = 0; i < other.counts_.size(); ++i)
+            {
+                counts_[i] += other.counts_[i];
+            }
+            count_ += other.count_;
+            sum_ += other.sum_;
+            max_ = std::max(max_, other.max_);
+        }
+
+        void reset()
+        {
+            counts_.clear();
+            count_ = 0;
+            sum_ = 0;
+            max_ = 0;
+        }
+
+        uint64_t count() const
+        {
+            return count_;
+        }
+
+        uint64_t sum() const
+        {
+            return sum_;
+        }
+
+        uint64_t max() const
+        {
+            return max_;
+        }
+
+        double mean() const
+        {
+            return count_ ? static_cast<double>(sum_) / count_ : 0.0;
+        }
+
+        //highest value equivalent to the bucket holding the p-th percentile, p in [0, 100]
+        uint64_t percentile(double p) const
+        {
+            if (0 == count_)
+            {
+                return 0;
+            }
+
+            p = std::clamp(p, 0.0, 100.0);
+            uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count_) + 0.5);
+            rank = std::clamp<uint64_t>(rank, 1, count_);
+            uint64_t n = 0;
+            for (size_t i = 0; i < counts_.size(); ++i)
+            {
+                n += counts_[i];
+                if (n >= rank)
+                {
+                    return std::min(bucket_upper(i), max_);
+                }
+            }
+            return max_;
+        }
+    private:
+        static size_t bucket_index(uint64_t v)
+        {
+            if (v < SUB_COUNT)
+            {
+                return static_cast<size_t>(v);
+            }
+            uint32_t msb = log2(v);
+            uint32_t shift = msb - SUB_BITS;
+            return static_cast<size_t>((msb - SUB_BITS + 1) * SUB_COUNT + ((v >> shift) & (SUB_COUNT - 1)));
+        }
+
+        static uint64_t bucket_upper(size_t index)
+        {
+            if (index < SUB_COUNT)
+            {
+                return index;
+            }
+            uint64_t msb = index / SUB_COUNT + SUB_BITS - 1;
+            uint64_t shift = msb - SUB_BITS;
+            uint64_t lower = (SUB_COUNT + (index & (SUB_COUNT - 1))) << shift;
+            return lower + (uint64_t{ 1 } << shift) - 1;
+        }
+
+        static uint32_t log2(uint64_t v)
+        {
+            uint32_t n = 0;
+            while (v >>= 1)
+            {
+                ++n;
+            }
+            return n;
+        }
+    private:
+        std::vector<uint64_t> counts_;
+        uint64_t count_ = 0;
+        uint64_t sum_ = 0;
+        uint64_t max_ = 0;
+    };
+
+    //message latency of a service or a worker, microseconds
+    struct latency_stats
+    {
+        //enqueued to the mailbox until dispatched
+        histogram wait;
+        //time spent in dispatch
+        histogram handle;
+        //garbage collection steps run in the worker's idle time
+        histogram gc;
+    };
+}
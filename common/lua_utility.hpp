@@ -62,6 +62,15 @@ namespace moon
         }
         return false;
     }
+
+    //opened by the first require, states that never use the library do not pay for it
+    inline void preload(lua_State* L, const char* name, lua_CFunction f)
+    {
+        luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+        lua_pushcfunction(L, f);
+        lua_setfield(L, -2, name);
+        lua_pop(L, 1);
+    }
   
     template<class LuaArrayView>
     class lua_array_view_iterator
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace moon
+{
+    template<typename T, typename Deleter>
+    class mpsc_queue;
+
+    //intrusive link, element type of mpsc_queue must derive from it
+    template<typename T>
+    class mpsc_queue_hook
+    {
+        template<typename, typename>
+        friend class mpsc_queue;
+
+        T* mpsc_next_ = nullptr;
+    };
+
+    /*
+        Lock-free intrusive multi-producer/single-consumer queue.
+        Producers push with a single CAS on the head (no node allocation),
+        the consumer detaches the whole chain with one exchange and restores FIFO order.
+    */
+    template<typename T, typename Deleter = std::default_delete<T>>
+    class mpsc_queue
+    {
+    public:
+        using value_type = std::unique_ptr<T, Deleter>;
+        using container_type = std::vector<value_type>;
+
+        mpsc_queue() = default;
+
+        mpsc_queue(const mpsc_queue&) = delete;
+
+        mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+        ~mpsc_queue()
+        {
+            container_type tmp;
+            swap(tmp);
+        }
+
+        //return true if queue was empty before push, caller should notify the consumer
+        bool push_back(value_type&& v)
+        {
+            T* node = v.release();
+            T* head = head_.load(std::memory_order_relaxed);
+            do
+            {
+                node->mpsc_next_ = head;
+            } while (!head_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+            return nullptr == head;
+        }
+
+        bool empty() const
+        {
+            return nullptr == head_.load(std::memory_order_acquire);
+        }
+
+        //only consumer thread: append all pending elements to 'other' in push order
+        void swap(container_type& other)
+        {
+            T* node = head_.exchange(nullptr, std::memory_order_acquire);
+            if (nullptr == node)
+            {
+                return;
+            }
+
+            T* prev = nullptr;
+            while (nullptr != node)
+            {
+                T* next = node->mpsc_next_;
+                node->mpsc_next_ = prev;
+                prev = node;
+                node = next;
+            }
+
+            while (nullptr != prev)
+            {
+                T* next = prev->mpsc_next_;
+                prev->mpsc_next_ = nullptr;
+                other.emplace_back(prev);
+                prev = next;
+            }
+        }
+    private:
+        std::atomic<T*> head_ = nullptr;
+    };
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+namespace moon
+{
+    /*
+        Lookup table for ids shaped as tag << 24 | counter, the way worker::uuid makes service ids.
+        Ids carrying this table's tag sit in a slot indexed by their low 16 bits, the slot keeps the
+        whole id so a reused slot never answers for an older id: a lookup is a bounds check and
+        one compare. Ids with another tag (services stolen from other workers) fall back to a map,
+        which is only searched while it is not empty.
+        Values are not owned.
+    */
+    template<typename T>
+    class slot_table
+    {
+        static constexpr uint32_t TAG_SHIFT = 24;
+        static constexpr uint32_t INDEX_MASK = 0xFFFF;
+
+        struct slot
+        {
+            uint32_t id = 0;
+            T* value = nullptr;
+        };
+    public:
+        explicit slot_table(uint32_t tag)
+            :tag_(tag)
+        {
+        }
+
+        T* find(uint32_t id) const
+        {
+            uint32_t index = id & INDEX_MASK;
+            if (index < slots_.size() && slots_[index].id == id)
+            {
+                return slots_[index].value;
+            }
+
+            if (others_.empty())
+            {
+                return nullptr;
+            }
+
+            if (auto iter = others_.find(id); iter != others_.end())
+            {
+                return iter->second;
+            }
+            return nullptr;
+        }
+
+        bool insert(uint32_t id, T* value)
+        {
+            if (0 == id || nullptr == value)
+            {
+                return false;
+            }
+
+            if ((id >> TAG_SHIFT) != tag_)
+            {
+                return others_.emplace(id, value).second;
+            }
+
+            uint32_t index = id & INDEX_MASK;
+            if (index >= slots_.size())
+            {
+                slots_.resize(index + 1);
+            }
+
+            slot& s = slots_[index];
+            if (nullptr != s.value)
+            {
+                return false;
+            }
+            s.id = id;
+            s.value = value;
+            return true;
+        }
+
+        bool erase(uint32_t id)
+        {
+            uint32_t index = id & INDEX_MASK;
+            if (index < slots_.size() && slots_[index].id == id)
+            {
+                slots_[index] = slot{};
+                return true;
+            }
+            return others_.erase(id) > 0;
+        }
+
+        void clear()
+        {
+            slots_.clear();
+            others_.clear();
+        }
+    private:
+        uint32_t tag_;
+        std::vector<slot> slots_;
+        std::unordered_map<uint32_t, T*> others_;
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include "spinlock.hpp"
+
+namespace moon
+{
+    /*
+        Read-mostly string keyed map, RCU style.
+        Writers copy the current snapshot, change the copy and publish it with a new version.
+        Each thread keeps the last snapshot it read, a reader only compares the version and
+        looks up its own snapshot: no lock, no allocation. The lock is taken once per thread
+        after each publish, to pick up the new snapshot.
+        Snapshots share their entries, publishing copies pointers, not keys and values.
+        The per thread cache is per Value type: instances of one type read alternately by the
+        same thread fall back to the locked path, keep them for rarely written data.
+    */
+    template<typename Value>
+    class snapshot_map
+    {
+        using entry_ptr = std::shared_ptr<const std::pair<const std::string, Value>>;
+
+        struct snapshot
+        {
+            uint64_t version = 0;
+            std::unordered_map<std::string_view, entry_ptr> data;
+        };
+
+        using snapshot_ptr = std::shared_ptr<const snapshot>;
+
+        struct cache
+        {
+            const snapshot_map* owner = nullptr;
+            uint64_t version = 0;
+            snapshot_ptr snap;
+        };
+    public:
+        snapshot_map()
+        {
+            auto s = std::make_shared<snapshot>();
+            s->version = next_version();
+            version_.store(s->version, std::memory_order_release);
+            current_ = std::move(s);
+        }
+
+        snapshot_map(const snapshot_map&) = delete;
+        snapshot_map& operator=(const snapshot_map&) = delete;
+
+        //points into this thread's snapshot, valid until this thread reads again after a publish
+        const Value* find(std::string_view key) const
+        {
+            const snapshot& s = read();
+            if (auto iter = s.data.find(key); iter != s.data.end())
+            {
+                return &iter->second->second;
+            }
+            return nullptr;
+        }
+
+        //insert or overwrite
+        void set(std::string_view key, Value value)
+        {
+            publish(key, std::move(value), true);
+        }
+
+        //false if key exists
+        bool try_set(std::string_view key, Value value)
+        {
+            return publish(key, std::move(value), false);
+        }
+
+        size_t size() const
+        {
+            return read().data.size();
+        }
+
+        //grows on every publish
+        uint64_t version() const
+        {
+            return version_.load(std::memory_order_acquire);
+        }
+    private:
+        //unique across instances, a new map at a freed one's address never matches a thread cache
+        static uint64_t next_version()
+        {
+            static std::atomic<uint64_t> counter{ 0 };
+            return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        const snapshot& read() const
+        {
+            cache& c = cache_;
+            if (c.owner != this || c.version != version_.load(std::memory_order_acquire))
+            {
+                std::lock_guard lock(lock_);
+                c.owner = this;
+                c.snap = current_;
+                c.version = c.snap->version;
+            }
+            return *c.snap;
+        }
+
+        bool publish(std::string_view key, Value&& value, bool overwrite)
+        {
+            std::lock_guard lock(lock_);
+            auto iter = current_->data.find(key);
+            if (iter != current_->data.end() && !overwrite)
+            {
+                return false;
+            }
+
+            auto next = std::make_shared<snapshot>(*current_);
+            next->version = next_version();
+            if (iter != current_->data.end())
+            {
+                next->data.erase(key);
+            }
+            auto e = std::make_shared<const std::pair<const std::string, Value>>(std::string{ key }, std::move(value));
+            next->data.emplace(e->first, std::move(e));
+            current_ = std::move(next);
+            version_.store(current_->version, std::memory_order_release);
+            return true;
+        }
+    private:
+        mutable spin_lock lock_;
+        snapshot_ptr current_;
+        std::atomic<uint64_t> version_{ 0 };
+        static inline thread_local cache cache_;
+    };
+}
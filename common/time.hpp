@@ -8,7 +8,9 @@ namespace moon
 {
     class time
     {
+    public:
         using time_point = std::chrono::time_point<std::chrono::steady_clock>;
+    private:
         inline static time_point start_time_point_ = std::chrono::steady_clock::now();
         inline static std::time_t start_millsecond = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
         inline static std::time_t offset_ = 0;
@@ -44,6 +46,12 @@ namespace moon
             return start_millsecond + diff.count() + offset_;
         }
 
+        //steady clock point at which now() reaches t
+        static time_point steady_time(std::time_t t)
+        {
+            return start_time_point_ + std::chrono::milliseconds(t - start_millsecond - offset_);
+        }
+
         //e. 2017-11-11 16:03:11.635
         static size_t milltimestamp(std::time_t t, char* buf, size_t len)
         {
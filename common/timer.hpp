@@ -2,32 +2,355 @@
 #include <cstdint>
 #include <functional>
 #include <cassert>
+#include <algorithm>
+#include <array>
+#include <limits>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 namespace moon
 {
     using timer_t = uint32_t;
 
-    template<typename ExpirePolicy>
+    //tickers ordered by expire time, O(log n) push
+    template<typename T>
+    class ordered_timer_queue
+    {
+    public:
+        using handle_type = typename std::multimap<int64_t, T>::iterator;
+
+        handle_type push(int64_t now, int64_t expiretime, T value)
+        {
+            (void)now;
+            return tickers_.emplace(expiretime, value);
+        }
+
+        void erase(handle_type h)
+        {
+            tickers_.erase(h);
+        }
+
+        int64_t expiretime(handle_type h) const
+        {
+            return h->first;
+        }
+
+        size_t size() const
+        {
+            return tickers_.size();
+        }
+
+        int64_t next_expiretime() const
+        {
+            return tickers_.empty() ? std::numeric_limits<int64_t>::max() : tickers_.begin()->first;
+        }
+
+        //pop expired tickers one by one, handler may push or erase other tickers
+        template<typename Handler>
+        void expire(int64_t now, Handler&& handler)
+        {
+            while (!tickers_.empty())
+            {
+                auto iter = tickers_.begin();
+                if (iter->first > now)
+                {
+                    break;
+                }
+                auto t = iter->first;
+                auto value = iter->second;
+                tickers_.erase(iter);
+                handler(t, value);
+            }
+        }
+    private:
+        std::multimap<int64_t, T> tickers_;
+    };
+
+    /*
+        Hierarchical timing wheel, one tick per millisecond.
+        A 256 slots near wheel and four 64 slots levels cover 2^32 ticks, farther
+        tickers wait in the last level and are placed again when it cascades.
+        Nodes are pooled and linked by index: push and erase are O(1) and do not
+        allocate once the pool has grown.
+    */
+    template<typename T>
+    class timing_wheel
+    {
+        static constexpr int NEAR_BITS = 8;
+        static constexpr int LEVEL_BITS = 6;
+        static constexpr int LEVELS = 4;
+        static constexpr int64_t NEAR_SIZE = int64_t{ 1 } << NEAR_BITS;
+        static constexpr int64_t LEVEL_SIZE = int64_t{ 1 } << LEVEL_BITS;
+        static constexpr int64_t NEAR_MASK = NEAR_SIZE - 1;
+        static constexpr int64_t LEVEL_MASK = LEVEL_SIZE - 1;
+        static constexpr uint32_t FAR_SLOT = static_cast<uint32_t>(NEAR_SIZE + (LEVELS - 1) * LEVEL_SIZE);
+        static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+        struct node
+        {
+            int64_t expiretime;
+            T value;
+            uint32_t slot;
+            uint32_t prev;
+            uint32_t next;
+        };
+
+        struct slot_list
+        {
+            uint32_t head = npos;
+            uint32_t tail = npos;
+        };
+    public:
+        using handle_type = uint32_t;
+
+        handle_type push(int64_t now, int64_t expiretime, T value)
+        {
+            if (0 == size_ && !expiring_)
+            {
+                current_ = now;
+            }
+
+            uint32_t idx = alloc();
+            node& n = nodes_[idx];
+            n.expiretime = expiretime;
+            n.value = value;
+            //the current tick has expired: fire at the next one at the earliest
+            link(idx, current_ + 1);
+            ++size_;
+            return idx;
+        }
+
+        void erase(handle_type h)
+        {
+            unlink(h);
+            release(h);
+            --size_;
+        }
+
+        int64_t expiretime(handle_type h) const
+        {
+            return nodes_[h].expiretime;
+        }
+
+        size_t size() const
+        {
+            return size_;
+        }
+
+        //nearest due tick in the near wheel, or the next cascade when only farther tickers remain
+        int64_t next_expiretime() const
+        {
+            if (0 == size_)
+            {
+                return std::numeric_limits<int64_t>::max();
+            }
+
+            if (near_size_ > 0)
+            {
+                for (int64_t t = current_ + 1; (t | NEAR_MASK) == (current_ | NEAR_MASK); ++t)
+                {
+                    if (slots_[t & NEAR_MASK].head != npos)
+                    {
+                        return t;
+                    }
+                }
+            }
+            return (current_ | NEAR_MASK) + 1;
+        }
+
+        //advance tick by tick up to 'now', handler may push or erase other tickers
+        template<typename Handler>
+        void expire(int64_t now, Handler&& handler)
+        {
+            expiring_ = true;
+            while (current_ < now)
+            {
+                if (0 == size_)
+                {
+                    current_ = now;
+                    break;
+                }
+
+                //nothing due before the next cascade
+                if (0 == near_size_)
+                {
+                    current_ = std::min(current_ | NEAR_MASK, now - 1);
+                }
+
+                ++current_;
+                if (0 == (current_ & NEAR_MASK))
+                {
+                    cascade();
+                }
+
+                slot_list& l = slots_[current_ & NEAR_MASK];
+                while (l.head != npos)
+                {
+                    uint32_t idx = l.head;
+                    int64_t t = nodes_[idx].expiretime;
+                    T value = nodes_[idx].value;
+                    erase(idx);
+                    handler(t, value);
+                }
+            }
+            expiring_ = false;
+        }
+    private:
+        uint32_t alloc()
+        {
+            if (free_ != npos)
+            {
+                uint32_t idx = free_;
+                free_ = nodes_[idx].next;
+                return idx;
+            }
+            nodes_.emplace_back();
+            return static_cast<uint32_t>(nodes_.size() - 1);
+        }
+
+        void release(uint32_t idx)
+        {
+            nodes_[idx].slot = npos;
+            nodes_[idx].next = free_;
+            free_ = idx;
+        }
+
+        //earliest: the first tick the node may fire at, it is already due otherwise
+        void link(uint32_t idx, int64_t earliest)
+        {
+            node& n = nodes_[idx];
+            int64_t t = std::max(n.expiretime, earliest);
+
+            uint32_t slot = FAR_SLOT;
+            if ((t | NEAR_MASK) == (current_ | NEAR_MASK))
+            {
+                slot = static_cast<uint32_t>(t & NEAR_MASK);
+            }
+            else
+            {
+                int64_t mask = NEAR_SIZE << LEVEL_BITS;
+                for (int i = 0; i < LEVELS; ++i)
+                {
+                    if ((t | (mask - 1)) == (current_ | (mask - 1)))
+                    {
+                        slot = static_cast<uint32_t>(NEAR_SIZE + i * LEVEL_SIZE + ((t >> (NEAR_BITS + i * LEVEL_BITS)) & LEVEL_MASK));
+                        break;
+                    }
+                    mask <<= LEVEL_BITS;
+                }
+            }
+
+            slot_list& l = slots_[slot];
+            n.slot = slot;
+            n.next = npos;
+            n.prev = l.tail;
+            if (l.tail != npos)
+            {
+                nodes_[l.tail].next = idx;
+            }
+            else
+            {
+                l.head = idx;
+            }
+            l.tail = idx;
+
+            if (slot < NEAR_SIZE)
+            {
+                ++near_size_;
+            }
+        }
+
+        void unlink(uint32_t idx)
+        {
+            node& n = nodes_[idx];
+            slot_list& l = slots_[n.slot];
+            if (n.prev != npos)
+            {
+                nodes_[n.prev].next = n.next;
+            }
+            else
+            {
+                l.head = n.next;
+            }
+
+            if (n.next != npos)
+            {
+                nodes_[n.next].prev = n.prev;
+            }
+            else
+            {
+                l.tail = n.prev;
+            }
+
+            if (n.slot < NEAR_SIZE)
+            {
+                --near_size_;
+            }
+        }
+
+        //current_ is at a near wheel boundary: move due level slots down
+        void cascade()
+        {
+            for (int i = 0; i < LEVELS; ++i)
+            {
+                int64_t idx = (current_ >> (NEAR_BITS + i * LEVEL_BITS)) & LEVEL_MASK;
+                slot_list& l = slots_[NEAR_SIZE + i * LEVEL_SIZE + idx];
+                uint32_t h = l.head;
+                l.head = l.tail = npos;
+                while (h != npos)
+                {
+                    uint32_t next = nodes_[h].next;
+                    //slot of current_ is expired right after the cascade, nodes due now still fire in this tick
+                    link(h, current_);
+                    h = next;
+                }
+
+                if (idx != 0)
+                {
+                    break;
+                }
+            }
+        }
+    private:
+        bool expiring_ = false;
+        int64_t current_ = 0;
+        size_t size_ = 0;
+        size_t near_size_ = 0;
+        uint32_t free_ = npos;
+        std::vector<node> nodes_;
+        std::array<slot_list, NEAR_SIZE + LEVELS * LEVEL_SIZE> slots_;
+    };
+
+    template<typename ExpirePolicy, template<typename> class TimerQueue = timing_wheel>
     class base_timer
     {
         using expire_policy_type = ExpirePolicy;
+        struct context;
+        //tickers point to contexts directly, expiring does not look up timers_
+        using queue_type = TimerQueue<context*>;
+        using handle_type = typename queue_type::handle_type;
         struct context
         {
         public:
             template<typename ...Args>
-            context(int32_t times, int64_t interval, Args&&... args)
-                :times_(times), interval_(interval), policy_(std::forward<Args>(args)...) {}
+            context(timer_t id, int32_t times, int64_t interval, Args&&... args)
+                :id_(id), times_(times), interval_(interval), policy_(std::forward<Args>(args)...) {}
 
             bool continued() noexcept { return (times_ < 0) || ((--times_) > 0); }
 
+            timer_t id_;
             int32_t	times_;
             int64_t interval_;
+            handle_type handle_{};
             expire_policy_type policy_;
         };
     public:
-        base_timer() = default;
+        //tag: high 8 bits of every timer id, keeps ids unique across timer instances
+        explicit base_timer(uint8_t tag = 0)
+            :tag_(tag)
+        {
+        }
 
         base_timer(const base_timer&) = delete;
         base_timer& operator=(const base_timer&) = delete;
@@ -39,27 +362,9 @@ namespace moon
                 return;
             }
 
-            do
-            {
-                auto iter = tickers_.begin();
-                if (iter == tickers_.end())
-                {
-                    break;
-                }
-
-                auto t = iter->first;
-
-                if (t > now)
-                {
-                    break;
-                }
-
-                auto id = iter->second;
-                tickers_.erase(iter);
-                expired(t, id);
-            } while (true);
-
-            return;
+            tickers_.expire(now, [this](int64_t expiretime, context* ctx) {
+                expired(expiretime, ctx);
+            });
         }
 
         void stop_all_timer()
@@ -81,8 +386,8 @@ namespace moon
             }
 
             timer_t id = create_timerid();
-            tickers_.emplace(now + interval, id);
-            timers_.emplace(id, context{ times, interval, std::forward<Args>(args)... });
+            auto res = timers_.try_emplace(id, id, times, interval, std::forward<Args>(args)...);
+            res.first->second.handle_ = tickers_.push(now, now + interval, &res.first->second);
             return id;
         }
 
@@ -90,7 +395,14 @@ namespace moon
         {
             if (auto iter = timers_.find(timerid); iter != timers_.end())
             {
-                iter->second.interval_ = 0;
+                //removed in its own callback, expired() erases it
+                if (timerid == expiring_)
+                {
+                    iter->second.interval_ = 0;
+                    return;
+                }
+                tickers_.erase(iter->second.handle_);
+                timers_.erase(iter);
             }
         }
 
@@ -99,40 +411,83 @@ namespace moon
             return timers_.size();
         }
 
+        //when update() has work to do next, never later than the nearest timer. max() if there is none
+        int64_t next_expiretime() const
+        {
+            if (stop_)
+            {
+                return std::numeric_limits<int64_t>::max();
+            }
+            return tickers_.next_expiretime();
+        }
+
+        //remove timers whose policy matches 'pred', pass their state to handler(id, expiretime, interval, times)
+        template<typename Pred, typename Handler>
+        void extract(Pred&& pred, Handler&& handler)
+        {
+            for (auto iter = timers_.begin(); iter != timers_.end();)
+            {
+                auto& ctx = iter->second;
+                if (iter->first != expiring_ && pred(ctx.policy_))
+                {
+                    handler(iter->first, tickers_.expiretime(ctx.handle_), ctx.interval_, ctx.times_);
+                    tickers_.erase(ctx.handle_);
+                    iter = timers_.erase(iter);
+                    continue;
+                }
+                ++iter;
+            }
+        }
+
+        //add a timer extracted from another instance, keeps its id and expire time
+        template<typename... Args>
+        bool insert(int64_t now, timer_t id, int64_t expiretime, int64_t interval, int32_t times, Args&&... args)
+        {
+            auto res = timers_.try_emplace(id, id, times, interval, std::forward<Args>(args)...);
+            if (!res.second)
+            {
+                return false;
+            }
+            res.first->second.handle_ = tickers_.push(now, expiretime, &res.first->second);
+            return true;
+        }
+
     private:
         timer_t create_timerid()
         {
+            timer_t id = 0;
             do
             {
                 ++uuid_;
-                if (uuid_ == 0 || uuid_ == std::numeric_limits<uint32_t>::max())
+                if (uuid_ > max_uuid)
                     uuid_ = 1;
-            } while (timers_.find(uuid_) != timers_.end());
-            return uuid_;
+                id = (static_cast<timer_t>(tag_) << 24) | uuid_;
+            } while (timers_.find(id) != timers_.end());
+            return id;
         }
 
-        void expired(int64_t now, timer_t id)
+        void expired(int64_t expiretime, context* ctx)
         {
-            if (auto iter = timers_.find(id); iter != timers_.end())
+            timer_t id = ctx->id_;
+            bool continued = ctx->continued();
+            expiring_ = id;
+            ctx->policy_(id, !continued);
+            expiring_ = 0;
+            if (ctx->interval_ != 0 && continued)//may remove timer in callback
             {
-                auto& ctx = iter->second;
-                if (ctx.interval_ != 0)//alive
-                {
-                    bool continued = ctx.continued();
-                    ctx.policy_(id, !continued);
-                    if (ctx.interval_!=0 && continued)//may remove timer in callback
-                    {
-                        tickers_.emplace(now + ctx.interval_, id);
-                        return;
-                    }
-                }
-                timers_.erase(id);
+                ctx->handle_ = tickers_.push(expiretime, expiretime + ctx->interval_, ctx);
+                return;
             }
+            timers_.erase(id);
         }
     private:
+        static constexpr uint32_t max_uuid = 0xFFFFFF;
+
         bool stop_ = false;
+        uint8_t tag_ = 0;
         uint32_t uuid_ = 0;
-        std::multimap<int64_t, uint32_t> tickers_;
+        timer_t expiring_ = 0;
+        queue_type tickers_;
         std::unordered_map<uint32_t, context> timers_;
     };
 
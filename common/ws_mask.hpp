@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// __AVX2__ needs -mavx2 or -march with AVX2, SSE2 is always there on x86-64.
+#if defined(__AVX2__)
+#  define MOON_WS_MASK_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define MOON_WS_MASK_SSE2
+#endif
+
+#if defined(MOON_WS_MASK_AVX2)
+#  include <immintrin.h>
+#elif defined(MOON_WS_MASK_SSE2)
+#  include <emmintrin.h>
+#endif
+
+namespace moon
+{
+    /*
+        Websocket payload masking: byte i is xor-ed with key[i % 4], masking and unmasking are the same.
+        The key repeats every 4 bytes, so 32, 16 or 8 bytes are xor-ed at a time with the key
+        broadcast to a whole register, the tail byte by byte.
+    */
+    inline void ws_mask(uint8_t* data, size_t len, const uint8_t* key)
+    {
+        uint32_t k = 0;
+        std::memcpy(&k, key, sizeof(k));
+        size_t i = 0;
+#if defined(MOON_WS_MASK_AVX2)
+        const __m256i k32 = _mm256_set1_epi32(static_cast<int>(k));
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(v, k32));
+        }
+#endif
+#if defined(MOON_WS_MASK_SSE2)
+        const __m128i k16 = _mm_set1_epi32(static_cast<int>(k));
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(v, k16));
+        }
+#endif
+        const uint64_t k8 = (static_cast<uint64_t>(k) << 32) | k;
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t v = 0;
+            std::memcpy(&v, data + i, sizeof(v));
+            v ^= k8;
+            std::memcpy(data + i, &v, sizeof(v));
+        }
+
+        for (; i < len; ++i)
+        {
+            data[i] ^= key[i & 3];
+        }
+    }
+}
@@ -31,6 +31,9 @@ switch[1] = function ()
     }
 end
 
+--- node 1 tests with every optional worker feature on, on several threads
+switch[14] = switch[1]
+
 switch[2] = function ()
     services = {
         {
@@ -190,6 +193,77 @@ switch[9] = function ()
     }
 end
 
+switch[10] = function ()
+    services = {
+        {
+            unique = true,
+            name = "mailbox_benchmark",
+            file = "start_by_config/mailbox_benchmark.lua",
+            threadid = 1
+        }
+    }
+end
+
+switch[11] = function ()
+    services = {
+        {
+            unique = true,
+            name = "pingpong_benchmark",
+            file = "start_by_config/pingpong_benchmark.lua",
+            threadid = 1
+        }
+    }
+end
+
+--- node 4 with 16 frames in flight per connection
+switch[13] = function ()
+    services = {
+        {
+            unique = true,
+            name= "server",
+            file = "start_by_config/network_benchmark.lua",
+            host = "127.0.0.1",
+            port = 42348,
+            master = true,
+            count = 4
+        },
+        {
+            unique = true,
+            name= "client",
+            file = "start_by_config/network_benchmark_client.lua",
+            host = "127.0.0.1",
+            port = 42348,
+            client_num = 1000,
+            count = 100,
+            pipeline = 16
+        }
+    }
+end
+
+--- network benchmark of node 4 on the io_uring backend
+switch[12] = function ()
+    services = {
+        {
+            unique = true,
+            name= "server",
+            file = "start_by_config/network_benchmark.lua",
+            host = "127.0.0.1",
+            port = 42347,
+            master = true,
+            count = 4
+        },
+        {
+            unique = true,
+            name= "client",
+            file = "start_by_config/network_benchmark_client.lua",
+            host = "127.0.0.1",
+            port = 42347,
+            client_num = 1000,
+            count = 100
+        }
+    }
+end
+
 local fn = switch[sid]
 if not fn then
     return 0
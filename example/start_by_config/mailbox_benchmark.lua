@@ -0,0 +1,74 @@
+local moon = require("moon")
+
+--- fan-in benchmark: N producer services on other workers flood one receiver's worker mailbox
+
+local conf = ...
+
+if conf.producer then
+    local command = {}
+
+    command.START = function(receiver, count)
+        for _=1,count do
+            moon.raw_send("text", receiver, "", "123456789")
+        end
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sz, len = moon.decode(msg, "C")
+        local cmd, receiver, count = unpack(sz, len)
+        command[cmd](receiver, count)
+    end)
+    return
+end
+
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+local rounds = conf.producers or {1, 4, 16, 64}
+local total = conf.total or 1000000
+
+local counter = 0
+local expect = 0
+local start_time = 0
+local stop_time = 0
+
+moon.dispatch("text", function()
+    counter = counter + 1
+    if counter == expect then
+        stop_time = moon.microseconds()
+    end
+end)
+
+moon.async(function()
+    print(string.format("mailbox benchmark: %d workers, %d messages per round", thread_num, total))
+    for _, n in ipairs(rounds) do
+        local producers = {}
+        for i=1,n do
+            --- keep receiver's worker(1) for itself when possible
+            local workerid = (thread_num > 1) and ((i-1)%(thread_num-1) + 2) or 1
+            producers[i] = moon.new_service("lua", {
+                name = "mailbox_producer",
+                file = "start_by_config/mailbox_benchmark.lua",
+                producer = true
+            }, false, workerid)
+        end
+
+        local count = total//n
+        counter = 0
+        expect = count*n
+        start_time = moon.microseconds()
+        for _, addr in ipairs(producers) do
+            moon.send("lua", addr, "START", moon.addr(), count)
+        end
+
+        while counter < expect do
+            moon.sleep(10)
+        end
+
+        local cost = (stop_time - start_time)/1000000
+        print(string.format("producers %3d: %d messages cost %.03fs, %.02f msg/s", n, expect, cost, expect/cost))
+
+        for _, addr in ipairs(producers) do
+            moon.remove_service(addr)
+        end
+    end
+    moon.exit(-1)
+end)
@@ -1,9 +1,10 @@
 local moon = require("moon")
+local json = require("json")
 local socket = require("moon.socket")
 
 local conf = ...
 
-local total,count,client_num,send_count
+local total,count,client_num,send_count,pipeline
 
 count = 0
 
@@ -13,21 +14,44 @@ local result = {}
 
 local connects = {}
 
+local recvs = {}
+
 local time_count = {}
 
 local send_data = "Hello World"
 
 local n = 0
 
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+
+local enter_start = 0
+
+--- io_uring_enter calls of all workers, nil on epoll: count its syscalls with strace -c -f
+local function uring_enters()
+    local n
+    for i = 1, thread_num do
+        local enter = json.decode(moon.wstate(i)).uring_enter
+        if enter then
+            n = (n or 0) + enter
+        end
+    end
+    return n
+end
+
 socket.on("connect",function(fd,msg)
-    connects[fd] = 1
+    connects[fd] = pipeline
+    recvs[fd] = 0
     n = n + 1
     if n == client_num then
         for k,v in pairs(connects) do
             time_count[k] = moon.now()
-            socket.write(k,send_data)
+            --- frames in flight per connection, written back to back
+            for _=1,v do
+                socket.write(k,send_data)
+            end
         end
         start_time = moon.now()
+        enter_start = uring_enters()
         print("start....")
     end
 end)
@@ -43,6 +67,7 @@ socket.on("message",function(fd, msg)
     result[diff] = v + 1
 
     local nc = connects[fd]
+    recvs[fd] = recvs[fd] + 1
 
     if nc < send_count then
         connects[fd] = nc + 1
@@ -50,6 +75,10 @@ socket.on("message",function(fd, msg)
         socket.write(fd,send_data)
         return
     end
+
+    if recvs[fd] < send_count then
+        return
+    end
     socket.close(fd)
     --print(fd,connects[fd],count,total)
 
@@ -70,6 +99,11 @@ socket.on("message",function(fd, msg)
         end
 
         print(string.format("%.02f requests per second",qps))
+
+        local enter_end = uring_enters()
+        if enter_end then
+            print(string.format("io_uring_enter per request %.04f", (enter_end - enter_start)/total))
+        end
     end
 end)
 
@@ -84,6 +118,7 @@ end)
 total = conf.client_num * conf.count
 client_num = conf.client_num
 send_count = conf.count
+pipeline = math.min(conf.pipeline or 1, send_count)
 
 moon.async(function()
     moon.sleep(10)
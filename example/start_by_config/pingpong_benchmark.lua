@@ -0,0 +1,111 @@
+local moon = require("moon")
+local json = require("json")
+
+--- ping-pong benchmark: two services on different workers bounce messages with a short header,
+--- reports message rate and how many memory blocks message/buffer pools requested from system.
+--- then one message at a time: round trip latency and mailbox wakeups (posted drains) per message
+
+local conf = ...
+
+if conf.pong then
+    moon.dispatch("text", function(msg)
+        local sender, header, data = moon.decode(msg, "SHZ")
+        moon.raw_send("text", sender, header, data)
+    end)
+    return
+end
+
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+local rounds = conf.rounds or 5
+local total = conf.total or 1000000
+local window = conf.window or 64
+
+local latency_total = conf.latency_total or 100000
+
+local counter = 0
+local expect = 0
+local pong = 0
+--- latency round: send time of the message in flight and each round trip in microseconds
+local sent_time = 0
+local samples
+
+moon.dispatch("text", function(msg)
+    local header, data = moon.decode(msg, "HZ")
+    counter = counter + 1
+    if samples then
+        local now = moon.microseconds()
+        samples[counter] = now - sent_time
+        if counter < expect then
+            sent_time = now
+            moon.raw_send("text", pong, header, data)
+        end
+        return
+    end
+    if counter + window <= expect then
+        moon.raw_send("text", pong, header, data)
+    end
+end)
+
+local function wakeups()
+    local n = 0
+    for i=1,thread_num do
+        n = n + json.decode(moon.wstate(i)).wakeup
+    end
+    return n
+end
+
+moon.async(function()
+    pong = moon.new_service("lua", {
+        name = "pingpong_pong",
+        file = "start_by_config/pingpong_benchmark.lua",
+        pong = true
+    }, false, (thread_num > 1) and 2 or 1)
+
+    print(string.format("pingpong benchmark: %d round trips per round, window %d", total, window))
+    for i=1,rounds do
+        counter = 0
+        expect = total
+        local allocated = moon.pool_allocated()
+        local before = wakeups()
+        local start_time = moon.microseconds()
+        for _=1,window do
+            moon.raw_send("text", pong, "PING", "123456789")
+        end
+
+        while counter < expect do
+            moon.sleep(10)
+        end
+
+        local cost = (moon.microseconds() - start_time)/1000000
+        local nmsg = 2*total
+        print(string.format("round %d: %d messages cost %.03fs, %.02f msg/s, pool allocations per message %.04f, wakeups per message %.04f",
+            i, nmsg, cost, nmsg/cost, (moon.pool_allocated() - allocated)/nmsg, (wakeups() - before)/nmsg))
+    end
+
+    print(string.format("pingpong latency: %d round trips one at a time", latency_total))
+    for i=1,rounds do
+        counter = 0
+        expect = latency_total
+        samples = {}
+        local before = wakeups()
+        sent_time = moon.microseconds()
+        moon.raw_send("text", pong, "PING", "123456789")
+
+        while counter < expect do
+            moon.sleep(10)
+        end
+
+        local nwakeup = wakeups() - before
+        table.sort(samples)
+        local sum = 0
+        for _, v in ipairs(samples) do
+            sum = sum + v
+        end
+        print(string.format("round %d: round trip mean %.02fus, p50 %dus, p99 %dus, max %dus, wakeups per message %.03f",
+            i, sum/#samples, samples[#samples//2], samples[math.ceil(#samples*0.99)], samples[#samples], nwakeup/(2*latency_total)))
+    end
+    samples = nil
+
+    moon.remove_service(pong)
+    moon.exit(-1)
+end)
@@ -46,6 +46,7 @@ equal(type(socket.close) , "function")
 equal(type(socket.settimeout) , "function")
 equal(type(socket.setnodelay) , "function")
 equal(type(socket.set_enable_chunked) , "function")
+equal(type(socket.set_framing) , "function")
 
 equal(type(moon.microseconds) , "function")
 
@@ -0,0 +1,63 @@
+local moon = require("moon")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.worker then
+    local data = {}
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, n = unpack(sz, len)
+        if cmd == "fill" then
+            for i = 1, n do
+                data[#data+1] = {id = i, name = "item" .. i, payload = string.rep("x", i % 200)}
+            end
+        elseif cmd == "clear" then
+            data = {}
+            collectgarbage("collect")
+        end
+        --- both read at the same call depth: growing the stack for a deeper call is counted too
+        local count = math.floor(collectgarbage("count") * 1024)
+        local used, reserved = moon.memory()
+        moon.response("lua", sender, sessionid, used, reserved, count)
+    end)
+    return
+end
+
+moon.async(function()
+    local with_arena = moon.new_service("lua", {
+        name = "test_arena_worker",
+        file = "start_by_config/test_arena.lua",
+        worker = true,
+        arena = true
+    })
+    local plain = moon.new_service("lua", {
+        name = "test_arena_plain",
+        file = "start_by_config/test_arena.lua",
+        worker = true
+    })
+
+    local used, reserved, count = moon.co_call("lua", with_arena, "fill", 20000)
+    test_assert.equal(used, count)
+    test_assert.assert(reserved >= used, "arena reserved less than used")
+
+    --- freed blocks stay in the arena and are reused
+    local _, reserved2 = moon.co_call("lua", with_arena, "clear")
+    test_assert.assert(reserved2 <= reserved, "arena grew after collect")
+    local used3, reserved3 = moon.co_call("lua", with_arena, "fill", 20000)
+    test_assert.assert(reserved3 <= reserved * 2, "freed blocks not reused")
+    test_assert.assert(reserved3 >= used3, "arena reserved less than used")
+
+    local pused, preserved, pcount = moon.co_call("lua", plain, "fill", 20000)
+    test_assert.equal(pused, pcount)
+    test_assert.equal(preserved, nil)
+
+    moon.co_remove_service(with_arena)
+    moon.co_remove_service(plain)
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    moon.quit()
+end)
@@ -0,0 +1,85 @@
+local moon = require("moon")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local NCOUNT = 1000
+
+if conf.receiver then
+    moon.batch_dispatch(true)
+
+    local expect_seq = 1
+
+    local command = {}
+
+    command.ADD = function(_, _, seq)
+        test_assert.equal(seq, expect_seq)
+        expect_seq = seq + 1
+    end
+
+    command.FAIL = function(_, _, seq)
+        error("batch dispatch fail "..seq)
+    end
+
+    command.CALL = function(sender, sessionid, seq)
+        moon.response("lua", sender, sessionid, seq)
+    end
+
+    command.QUERY = function(sender, sessionid)
+        moon.response("lua", sender, sessionid, expect_seq - 1)
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, seq = unpack(sz, len)
+        command[cmd](sender, sessionid, seq)
+    end)
+    return
+end
+
+local receiver = 0
+
+moon.async(function()
+    --- same worker: everything sent below lands in one mailbox drain
+    receiver = moon.new_service("lua", {
+        name = "test_batch_dispatch_receiver",
+        file = "start_by_config/test_batch_dispatch.lua",
+        receiver = true
+    }, false, moon.addr() >> 24)
+
+    local results = {}
+    for seq=1,NCOUNT do
+        moon.send("lua", receiver, "ADD", seq)
+        if seq % 100 == 0 then
+            --- a failed message must not drop the rest of the batch
+            moon.send("lua", receiver, "FAIL", seq)
+            moon.async(function()
+                local ok, err = moon.co_call("lua", receiver, "FAIL", seq)
+                test_assert.equal(ok, false)
+                test_assert.assert(string.find(err, "batch dispatch fail "..seq, 1, true), err)
+                results[#results+1] = seq
+            end)
+            moon.async(function()
+                test_assert.equal(moon.co_call("lua", receiver, "CALL", seq), seq)
+                results[#results+1] = seq
+            end)
+        end
+    end
+
+    test_assert.equal(moon.co_call("lua", receiver, "QUERY"), NCOUNT)
+    test_assert.equal(#results, NCOUNT//100*2)
+
+    moon.send("lua", receiver, "FAIL", 0)
+    test_assert.equal(moon.co_call("lua", receiver, "CALL", 1), 1)
+
+    moon.co_remove_service(receiver)
+    receiver = 0
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    if receiver ~= 0 then
+        moon.remove_service(receiver)
+    end
+    moon.quit()
+end)
@@ -0,0 +1,79 @@
+local moon = require("moon")
+local json = require("json")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.worker then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, n = unpack(sz, len)
+        if cmd == "garbage" then
+            local t = {}
+            for i = 1, n do
+                t[i] = {id = i, name = "item" .. i}
+            end
+        end
+        moon.response("lua", sender, sessionid, moon.memory())
+    end)
+    return
+end
+
+local idle_gc = 0
+local node = math.tointeger(moon.get_env("NODE"))
+for _, c in ipairs(json.decode(moon.get_env("CONFIG"))) do
+    if c.node == node then
+        idle_gc = c.idle_gc or 0
+    end
+end
+
+local worker = 0
+
+moon.async(function()
+    local workerid = moon.addr() >> 24
+    worker = moon.new_service("lua", {
+        name = "test_idle_gc_worker",
+        file = "start_by_config/test_idle_gc.lua",
+        worker = true
+    }, false, workerid)
+
+    --- garbage left by the message is collected while the worker has nothing to do
+    local used = moon.co_call("lua", worker, "garbage", 100000)
+    moon.sleep(100)
+    local now = moon.co_call("lua", worker, "memory")
+
+    local state = json.decode(moon.wstate(workerid))
+    if idle_gc == 0 then
+        --- disabled: no idle steps, the garbage waits for the regular collector
+        test_assert.equal(state.gc_steps, 0)
+        moon.co_remove_service(worker)
+        worker = 0
+        test_assert.success()
+        return
+    end
+
+    test_assert.assert(now < used // 2, string.format("garbage not collected: %d -> %d", used, now))
+    test_assert.greater(state.gc_steps, 0)
+    test_assert.assert(state.gc_max <= state.gc_time, "gc_max > gc_time")
+
+    local stats = json.decode(moon.co_runcmd("worker."..workerid..".stats"))
+    local found
+    for _, s in ipairs(stats.services) do
+        if tonumber(s.serviceid, 16) == worker then
+            found = s
+        end
+    end
+    test_assert.assert(found, "worker service not in stats")
+    test_assert.greater(found.gc.count, 0)
+
+    moon.co_remove_service(worker)
+    worker = 0
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    if worker ~= 0 then
+        moon.remove_service(worker)
+    end
+    moon.quit()
+end)
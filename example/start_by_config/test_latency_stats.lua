@@ -0,0 +1,62 @@
+local moon = require("moon")
+local json = require("json")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.echo then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        moon.response("lua", sender, sessionid, unpack(sz, len))
+    end)
+    return
+end
+
+local echo = 0
+
+moon.async(function()
+    local workerid = moon.addr() >> 24
+    echo = moon.new_service("lua", {
+        name = "test_latency_stats_echo",
+        file = "start_by_config/test_latency_stats.lua",
+        echo = true
+    }, false, workerid)
+
+    for i=1,100 do
+        test_assert.equal(moon.co_call("lua", echo, i), i)
+    end
+
+    local stats = json.decode(moon.co_runcmd("worker."..workerid..".stats"))
+    test_assert.equal(stats.worker, workerid)
+    test_assert.greater(stats.wait.count, 0)
+    test_assert.greater(stats.handle.count, 0)
+
+    local found
+    for _, s in ipairs(stats.services) do
+        if tonumber(s.serviceid, 16) == echo then
+            found = s
+        end
+    end
+    test_assert.assert(found, "echo service not in stats")
+    test_assert.assert(found.wait.count >= 100, found.wait.count)
+    test_assert.assert(found.handle.count >= 100, found.handle.count)
+    test_assert.assert(found.handle.p99 >= found.handle.p50, "p99 < p50")
+    test_assert.assert(found.handle.max >= found.handle.p99, "max < p99")
+
+    local metrics = moon.co_runcmd("worker."..workerid..".metrics")
+    test_assert.assert(string.find(metrics, "# TYPE moon_message_wait_microseconds summary", 1, true), metrics)
+    local label = string.format('moon_message_handle_microseconds_count{worker="%d",service="test_latency_stats_echo",serviceid="%08X"}', workerid, echo)
+    local count = string.match(metrics, label:gsub("%p", "%%%0").." (%d+)")
+    test_assert.assert(count and tonumber(count) >= 100, metrics)
+
+    moon.co_remove_service(echo)
+    echo = 0
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    if echo ~= 0 then
+        moon.remove_service(echo)
+    end
+    moon.quit()
+end)
@@ -0,0 +1,102 @@
+local moon = require("moon")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local HOST = "127.0.0.1"
+local PORT = 30006
+local NCLIENT = 100
+
+if conf.owner then
+    local accepted = 0
+
+    socket.on("accept",function(fd, msg)
+        accepted = accepted + 1
+    end)
+
+    socket.on("message",function(fd, msg)
+        socket.write_message(fd, msg)
+    end)
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid = moon.decode(msg, "SE")
+        moon.response("lua", sender, sessionid, accepted)
+    end)
+    return
+end
+
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+
+local owners = {}
+
+moon.async(function()
+    for i = 1, 2 do
+        owners[i] = moon.new_service("lua", {
+            name = "test_listen_sharded_owner",
+            file = "start_by_config/test_listen_sharded.lua",
+            owner = true
+        })
+    end
+
+    --- an owner that runs on another worker than the one in its id still gets its connections
+    local other = (owners[2] >> 24) % thread_num + 1
+    if thread_num > 1 then
+        test_assert.equal(moon.co_migrate(owners[2], other), true)
+    end
+
+    local listenfd = socket.listen_sharded(HOST, PORT, moon.PTYPE_SOCKET, owners)
+    test_assert.assert(listenfd > 0, "listen_sharded failed")
+
+    --- owners stay on their workers while they own the listener
+    if thread_num > 1 then
+        local ok, err = moon.co_migrate(owners[2], (owners[2] >> 24))
+        test_assert.equal(ok, false)
+        test_assert.assert(string.find(err, "owns sockets", 1, true), err)
+    end
+
+    local done = 0
+    for i = 1, NCLIENT do
+        local fd, err = socket.connect(HOST, PORT, moon.PTYPE_TEXT)
+        test_assert.assert(fd, err)
+        moon.async(function()
+            local data = tostring(i)
+            socket.write(fd, string.pack(">H", #data)..data)
+            local msg = socket.read(fd, 2)
+            test_assert.assert(msg, "read failed")
+            local len = string.unpack(">H", msg)
+            test_assert.equal(socket.read(fd, len), data)
+            socket.close(fd)
+            done = done + 1
+        end)
+    end
+
+    while done < NCLIENT do
+        moon.sleep(10)
+    end
+
+    --- every connection went to one of the owners. the worker accept counters are shared with other tests
+    local n = 0
+    for _, owner in ipairs(owners) do
+        n = n + moon.co_call("lua", owner)
+    end
+    test_assert.equal(n, NCLIENT)
+
+    --- closing the fd closes the listeners of all workers
+    test_assert.assert(socket.close(listenfd), "close failed")
+    moon.sleep(10)
+    test_assert.assert(socket.try_open(HOST, PORT), "port still in use")
+
+    for _, owner in ipairs(owners) do
+        moon.co_remove_service(owner)
+    end
+    owners = {}
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, owner in ipairs(owners) do
+        moon.remove_service(owner)
+    end
+    moon.quit()
+end)
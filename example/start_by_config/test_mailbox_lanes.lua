@@ -0,0 +1,102 @@
+local moon = require("moon")
+local json = require("json")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local NCOUNT = 5000
+
+if conf.echo then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        moon.response("lua", sender, sessionid, unpack(sz, len))
+    end)
+    return
+end
+
+local mailbox_lanes = false
+local node = math.tointeger(moon.get_env("NODE"))
+for _, c in ipairs(json.decode(moon.get_env("CONFIG"))) do
+    if c.node == node then
+        mailbox_lanes = c.mailbox_lanes
+    end
+end
+
+if conf.client then
+    local handled = 0
+
+    --- the call is queued in front of a flood of normal messages, its response behind them
+    local function run()
+        local before, lanes
+        moon.async(function()
+            test_assert.equal(moon.co_call("lua", conf.echo_addr, "PING"), "PING")
+            before = handled
+            lanes = json.decode(moon.wstate(moon.addr() >> 24)).lanes
+        end)
+        for seq=1,NCOUNT do
+            moon.send("lua", moon.addr(), "ADD", seq)
+        end
+
+        while handled < NCOUNT or not before do
+            moon.sleep(10)
+        end
+        return before, lanes[3]
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, seq = unpack(sz, len)
+        if cmd == "ADD" then
+            --- normal messages keep their order
+            test_assert.equal(seq, handled + 1)
+            handled = seq
+        elseif cmd == "RUN" then
+            moon.async(function()
+                moon.response("lua", sender, sessionid, run())
+            end)
+        end
+    end)
+    return
+end
+
+local services = {}
+
+moon.async(function()
+    --- both bound to one worker: work stealing would move the flooded client away,
+    --- and messages to a moved service are forwarded in order
+    local workerid = moon.addr() >> 24
+    local echo = moon.new_service("lua", {
+        name = "test_mailbox_lanes_echo",
+        file = "start_by_config/test_mailbox_lanes.lua",
+        echo = true
+    }, false, workerid)
+    table.insert(services, echo)
+    local client = moon.new_service("lua", {
+        name = "test_mailbox_lanes_client",
+        file = "start_by_config/test_mailbox_lanes.lua",
+        client = true,
+        echo_addr = echo
+    }, false, workerid)
+    table.insert(services, client)
+
+    local before, normal = moon.co_call("lua", client, "RUN")
+    if mailbox_lanes then
+        test_assert.assert(before < NCOUNT, "response waited behind the flood")
+        test_assert.greater(normal, 0)
+    else
+        test_assert.equal(before, NCOUNT)
+    end
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    services = {}
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
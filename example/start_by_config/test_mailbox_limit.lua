@@ -0,0 +1,161 @@
+local moon = require("moon")
+local json = require("json")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local HOST = "127.0.0.1"
+local PORT = 30004
+local WS_PORT = 30010
+
+if conf.receiver then
+    local received = {}
+
+    local command = {}
+
+    command.ADD = function(_, _, seq)
+        table.insert(received, seq)
+    end
+
+    command.QUERY = function(sender, sessionid)
+        moon.response("lua", sender, sessionid, received)
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, seq = unpack(sz, len)
+        command[cmd](sender, sessionid, seq)
+    end)
+
+    if conf.mailbox_policy == "backpressure" then
+        local listenfd = socket.listen(HOST, PORT, moon.PTYPE_SOCKET)
+        socket.start(listenfd)
+        --- fill own mailbox, reading the socket pauses until it drains
+        local function echo(fd, msg)
+            for i=1,conf.mailbox_limit*2 do
+                moon.send("lua", moon.addr(), "ADD", i)
+            end
+            socket.write_message(fd, msg)
+        end
+        socket.on("message", echo)
+
+        local wsfd = socket.listen(HOST, WS_PORT, moon.PTYPE_SOCKET_WS)
+        socket.start(wsfd)
+        socket.wson("message", echo)
+    end
+    return
+end
+
+local function new_receiver(policy)
+    return moon.new_service("lua", {
+        name = "test_mailbox_limit_"..policy,
+        file = "start_by_config/test_mailbox_limit.lua",
+        receiver = true,
+        mailbox_limit = 10,
+        mailbox_policy = policy
+    }, false, moon.addr() >> 24)
+end
+
+local function wstate()
+    return json.decode(moon.wstate(moon.addr() >> 24))
+end
+
+local services = {}
+
+local ws_echoes = {}
+
+socket.wson("connect",function(fd)
+    --- frames can be sent once the handshake is done, the writes go out together
+    for i=1,3 do
+        socket.write(fd, tostring(i))
+    end
+end)
+
+socket.wson("message",function(_, msg)
+    table.insert(ws_echoes, moon.decode(msg, "Z"))
+end)
+
+moon.async(function()
+    --- everything below runs before the receivers' worker drains its mailbox
+    local state = wstate()
+
+    local reject = new_receiver("reject")
+    table.insert(services, reject)
+    for seq=1,100 do
+        moon.send("lua", reject, "ADD", seq)
+    end
+    local ok, err = moon.co_call("lua", reject, "QUERY")
+    test_assert.equal(ok, false)
+    test_assert.assert(string.find(err, "mailbox full", 1, true), err)
+    --- with mailbox lanes the rejection overtakes the ADDs queued before it,
+    --- call again until the mailbox has room: the accepted call queues behind them
+    local received
+    for _=1,100 do
+        received = moon.co_call("lua", reject, "QUERY")
+        if received then
+            break
+        end
+    end
+    test_assert.assert(received, "mailbox still full")
+    test_assert.equal(#received, 10)
+    test_assert.equal(received[1], 1)
+    test_assert.equal(received[10], 10)
+
+    local drop = new_receiver("drop_oldest")
+    table.insert(services, drop)
+    for seq=1,100 do
+        moon.send("lua", drop, "ADD", seq)
+    end
+    received = moon.co_call("lua", drop, "QUERY")
+    --- 101 pending with the call itself, keep the newest 10
+    test_assert.equal(#received, 9)
+    test_assert.equal(received[1], 92)
+    test_assert.equal(received[9], 100)
+
+    local backpressure = new_receiver("backpressure")
+    table.insert(services, backpressure)
+    local fd = socket.connect(HOST, PORT, moon.PTYPE_TEXT)
+    test_assert.assert(fd, "connect failed")
+    --- all frames in one write: the connection pauses between frames of the same read
+    local data = ""
+    for i=1,3 do
+        data = data..string.pack(">s2", tostring(i))
+    end
+    socket.write(fd, data)
+    for i=1,3 do
+        local len = string.unpack(">H", socket.read(fd, 2))
+        test_assert.equal(socket.read(fd, len), tostring(i))
+    end
+    socket.close(fd)
+
+    --- same for websocket frames
+    fd = socket.connect(HOST, WS_PORT, moon.PTYPE_SOCKET_WS)
+    test_assert.assert(fd, "connect failed")
+    for _=1,100 do
+        if #ws_echoes == 3 then
+            break
+        end
+        moon.sleep(10)
+    end
+    test_assert.equal(table.concat(ws_echoes, ","), "1,2,3")
+    socket.close(fd)
+
+    local now = wstate()
+    test_assert.assert(now.mailbox_rejected - state.mailbox_rejected >= 90, now.mailbox_rejected)
+    test_assert.assert(now.mailbox_dropped - state.mailbox_dropped >= 91, now.mailbox_dropped)
+    test_assert.assert(now.mailbox_paused - state.mailbox_paused >= 6, now.mailbox_paused)
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    services = {}
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
@@ -0,0 +1,188 @@
+local moon = require("moon")
+local json = require("json")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local NCOUNT = 2000
+local PORT = 30011
+
+if conf.busy then
+    --- keeps its worker slow to drain
+    moon.dispatch('lua',function()
+        local t = os.clock()
+        while os.clock() - t < 0.02 do
+        end
+    end)
+    return
+end
+
+if conf.worker then
+    local expect_seq = 1
+    local ticks = 0
+
+    moon.repeated(1, -1, function()
+        ticks = ticks + 1
+    end)
+
+    local command = {}
+
+    command.WORK = function(_, _, seq)
+        --- messages keep their order across the move
+        test_assert.equal(seq, expect_seq)
+        expect_seq = seq + 1
+    end
+
+    command.MOVE = function(sender, sessionid, workerid)
+        moon.async(function()
+            moon.response("lua", sender, sessionid, moon.co_migrate(moon.addr(), workerid))
+        end)
+    end
+
+    command.LISTEN = function(sender, sessionid)
+        moon.response("lua", sender, sessionid, socket.listen("127.0.0.1", PORT, moon.PTYPE_SOCKET))
+    end
+
+    command.CLOSE = function(sender, sessionid, fd)
+        moon.response("lua", sender, sessionid, socket.close(fd))
+    end
+
+    command.DONE = function(sender, sessionid)
+        moon.async(function()
+            local t = ticks
+            moon.sleep(50)
+            moon.response("lua", sender, sessionid, expect_seq - 1, ticks - t)
+        end)
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, seq = unpack(sz, len)
+        command[cmd](sender, sessionid, seq)
+    end)
+    return
+end
+
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+
+local function running_on(workerid, addr)
+    for _, s in ipairs(json.decode(moon.co_runcmd("worker."..workerid..".services"))) do
+        if tonumber(s.serviceid, 16) == addr then
+            return true
+        end
+    end
+    return false
+end
+
+local services = {}
+
+moon.async(function()
+    local home = moon.addr() >> 24
+    local worker = moon.new_service("lua", {
+        name = "test_migrate_worker",
+        file = "start_by_config/test_migrate.lua",
+        worker = true
+    }, false, home)
+    table.insert(services, worker)
+
+    local ok, err = moon.co_migrate(worker, 255)
+    test_assert.equal(ok, false)
+    test_assert.assert(string.find(err, "not found", 1, true), err)
+    ok, err = moon.co_migrate((home << 24) | 0xFFFF, home)
+    test_assert.equal(ok, false)
+    test_assert.assert(string.find(err, "not found", 1, true), err)
+    test_assert.equal(moon.co_migrate(worker, home), true)
+
+    if thread_num < 2 then
+        moon.co_remove_service(worker)
+        services = {}
+        test_assert.success()
+        return
+    end
+
+    local other = home % thread_num + 1
+
+    --- a service that owns a socket stays on its worker until the socket is closed
+    local listenfd = moon.co_call("lua", worker, "LISTEN")
+    test_assert.assert(listenfd > 0, "listen failed")
+    ok, err = moon.co_migrate(worker, other)
+    test_assert.equal(ok, false)
+    test_assert.assert(string.find(err, "owns sockets", 1, true), err)
+    test_assert.equal(moon.co_call("lua", worker, "CLOSE", listenfd), true)
+
+    local before = json.decode(moon.wstate(other)).migrate_in
+
+    --- move while its mailbox is full, then move it back from inside the service
+    for seq=1,NCOUNT do
+        moon.send("lua", worker, "WORK", seq)
+        if seq == NCOUNT // 2 then
+            moon.async(function()
+                test_assert.equal(moon.co_migrate(worker, other), true)
+            end)
+        end
+    end
+    local n, ticks = moon.co_call("lua", worker, "DONE")
+    test_assert.equal(n, NCOUNT)
+    test_assert.greater(ticks, 0)
+    test_assert.assert(running_on(other, worker), "service not on the new worker")
+    test_assert.assert(not running_on(home, worker), "service still on the old worker")
+    test_assert.greater(json.decode(moon.wstate(other)).migrate_in, before)
+
+    test_assert.equal(moon.co_call("lua", worker, "MOVE", home), true)
+    for seq=NCOUNT+1,NCOUNT*2 do
+        moon.send("lua", worker, "WORK", seq)
+    end
+    n, ticks = moon.co_call("lua", worker, "DONE")
+    test_assert.equal(n, NCOUNT * 2)
+    test_assert.greater(ticks, 0)
+    test_assert.assert(running_on(home, worker), "service not moved back")
+
+    --- there and back while messages are still on their way to the other worker: they are handled
+    --- before the ones sent once the service is home again. the busy service, routed by the same
+    --- worker, holds them up there
+    local busy = moon.new_service("lua", {
+        name = "test_migrate_busy",
+        file = "start_by_config/test_migrate.lua",
+        busy = true
+    }, false, home)
+    table.insert(services, busy)
+    test_assert.equal(moon.co_migrate(busy, other), true)
+
+    local seq = NCOUNT * 2
+    for _ = 1, 5 do
+        test_assert.equal(moon.co_migrate(worker, other), true)
+        local back = false
+        moon.async(function()
+            test_assert.equal(moon.co_migrate(worker, home), true)
+            for _ = 1, 100 do
+                seq = seq + 1
+                moon.send("lua", worker, "WORK", seq)
+            end
+            back = true
+        end)
+        moon.send("lua", busy)
+        for _ = 1, 100 do
+            seq = seq + 1
+            moon.send("lua", worker, "WORK", seq)
+        end
+        while not back do
+            moon.sleep(10)
+        end
+    end
+    n = moon.co_call("lua", worker, "DONE")
+    test_assert.equal(n, seq)
+    test_assert.assert(running_on(home, worker), "service not moved back")
+
+    moon.co_remove_service(busy)
+    moon.co_remove_service(worker)
+    services = {}
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
@@ -46,6 +46,86 @@ local test_case =
         name = "test_http",
         file = "start_by_config/test_http.lua"
     }
+    ,
+    {
+        name = "test_work_stealing",
+        file = "start_by_config/test_work_stealing.lua"
+    }
+    ,
+    {
+        name = "test_publish",
+        file = "start_by_config/test_publish.lua"
+    }
+    ,
+    {
+        name = "test_batch_dispatch",
+        file = "start_by_config/test_batch_dispatch.lua"
+    }
+    ,
+    {
+        name = "test_latency_stats",
+        file = "start_by_config/test_latency_stats.lua"
+    }
+    ,
+    {
+        name = "test_mailbox_limit",
+        file = "start_by_config/test_mailbox_limit.lua"
+    }
+    ,
+    {
+        name = "test_ws_frame",
+        file = "start_by_config/test_ws_frame.lua"
+    }
+    ,
+    {
+        name = "test_precise_timer",
+        file = "start_by_config/test_precise_timer.lua"
+    }
+    ,
+    {
+        name = "test_registry",
+        file = "start_by_config/test_registry.lua"
+    }
+    ,
+    {
+        name = "test_vm_pool",
+        file = "start_by_config/test_vm_pool.lua"
+    }
+    ,
+    {
+        name = "test_arena",
+        file = "start_by_config/test_arena.lua"
+    }
+    ,
+    {
+        name = "test_idle_gc",
+        file = "start_by_config/test_idle_gc.lua"
+    }
+    ,
+    {
+        name = "test_migrate",
+        file = "start_by_config/test_migrate.lua"
+    }
+    ,
+    {
+        name = "test_mailbox_lanes",
+        file = "start_by_config/test_mailbox_lanes.lua"
+    }
+    ,
+    {
+        name = "test_listen_sharded",
+        file = "start_by_config/test_listen_sharded.lua"
+    }
+    ,
+    {
+        name = "test_moon_pipeline",
+        file = "start_by_config/test_moon_pipeline.lua"
+    }
+    ,
+    {
+        name = "test_moon_framing",
+        file = "start_by_config/test_moon_framing.lua"
+    }
 }
 
 local next_case = function ()
@@ -0,0 +1,120 @@
+local moon = require("moon")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local HOST = "127.0.0.1"
+local PORT_U32 = 30008
+local PORT_VARINT = 30009
+
+--- large messages go in one frame, small ones are mixed in
+local sizes = { 1, 127, 128, 16384, 65535, 65536, 100 * 1024, 3, 2 * 1024 * 1024, 300 }
+local payloads = {}
+for i, size in ipairs(sizes) do
+    payloads[i] = string.rep(string.char(65 + i), size)
+end
+
+local function varint(n)
+    local t = {}
+    repeat
+        local b = n & 0x7F
+        n = n >> 7
+        if n ~= 0 then
+            b = b | 0x80
+        end
+        t[#t + 1] = string.char(b)
+    until n == 0
+    return table.concat(t)
+end
+
+local clients = {}
+local closed = {}
+
+local function listen(port, mode)
+    local listenfd = socket.listen(HOST, port, moon.PTYPE_SOCKET)
+    test_assert.assert(socket.set_framing(listenfd, mode), "set_framing failed")
+    socket.start(listenfd)
+    return listenfd
+end
+
+local listen_u32 = listen(PORT_U32, "u32")
+local listen_varint = listen(PORT_VARINT, "varint")
+
+test_assert.assert(not socket.set_framing(listen_u32, "u64"), "unsupported framing accepted")
+
+socket.on("message",function(fd, msg)
+    local client = clients[fd]
+    if client then
+        client.received[#client.received + 1] = moon.decode(msg, "Z")
+        return
+    end
+    socket.write_message(fd, msg)
+end)
+
+socket.on("error",function(fd, msg)
+    --- closing a client aborts its pending read
+    if not closed[fd] then
+        test_assert.assert(false, moon.decode(msg, "Z"))
+    end
+end)
+
+local function echo(port, mode)
+    local fd = socket.sync_connect(HOST, port, moon.PTYPE_SOCKET)
+    test_assert.assert(fd > 0, "connect server failed")
+    test_assert.assert(socket.set_framing(fd, mode), "set_framing failed")
+    local client = { received = {} }
+    clients[fd] = client
+
+    for _, data in ipairs(payloads) do
+        socket.write(fd, data)
+    end
+
+    while #client.received < #payloads do
+        moon.sleep(10)
+    end
+
+    for i, data in ipairs(payloads) do
+        test_assert.equal(#client.received[i], #data)
+        test_assert.assert(client.received[i] == data, "payload mismatch")
+    end
+    clients[fd] = nil
+    closed[fd] = true
+    socket.close(fd)
+end
+
+--- the header on the wire, read by a raw client
+local function raw(port, header, unpack_header)
+    local fd, err = socket.connect(HOST, port, moon.PTYPE_TEXT)
+    test_assert.assert(fd, err)
+    local data = string.rep("x", 300)
+    socket.write(fd, header(#data)..data)
+    test_assert.equal(unpack_header(fd), #data)
+    test_assert.equal(socket.read(fd, #data), data)
+    socket.close(fd)
+end
+
+moon.async(function()
+    echo(PORT_U32, "u32")
+    echo(PORT_VARINT, "varint")
+
+    raw(PORT_U32, function(n)
+        return string.pack(">I4", n)
+    end, function(fd)
+        return string.unpack(">I4", socket.read(fd, 4))
+    end)
+
+    raw(PORT_VARINT, varint, function(fd)
+        local n, shift = 0, 0
+        while true do
+            local b = string.byte(socket.read(fd, 1))
+            n = n | ((b & 0x7F) << shift)
+            shift = shift + 7
+            if b & 0x80 == 0 then
+                return n
+            end
+        end
+    end)
+
+    socket.close(listen_u32)
+    socket.close(listen_varint)
+    test_assert.success()
+end)
@@ -0,0 +1,50 @@
+local moon = require("moon")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local HOST = "127.0.0.1"
+local PORT = 30007
+
+--- small and large frames back to back in one write, some of them split over several reads
+local frames = {}
+for i = 1, 200 do
+    local size = (i % 50 == 0) and (20000 + i) or (i % 7)
+    frames[i] = string.rep(string.char(65 + i % 26), size)
+end
+
+local listenfd = socket.listen(HOST, PORT, moon.PTYPE_SOCKET)
+socket.start(listenfd)
+
+socket.on("message",function(fd, msg)
+    socket.write_message(fd, msg)
+end)
+
+socket.on("error",function(_, msg)
+    test_assert.assert(false, moon.decode(msg, "Z"))
+end)
+
+moon.async(function()
+    local fd, err = socket.connect(HOST, PORT, moon.PTYPE_TEXT)
+    test_assert.assert(fd, err)
+
+    local packed = {}
+    for i, data in ipairs(frames) do
+        packed[i] = string.pack(">s2", data)
+    end
+    socket.write(fd, table.concat(packed))
+
+    for i, data in ipairs(frames) do
+        local header = socket.read(fd, 2)
+        test_assert.assert(header, "read failed")
+        local len = string.unpack(">H", header)
+        test_assert.equal(len, #data)
+        if len > 0 then
+            test_assert.equal(socket.read(fd, len), data)
+        end
+        frames[i] = nil
+    end
+
+    socket.close(fd)
+    socket.close(listenfd)
+    test_assert.success()
+end)
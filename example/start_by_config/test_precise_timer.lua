@@ -0,0 +1,53 @@
+local moon = require("moon")
+local json = require("json")
+local test_assert = require("test_assert")
+
+local precise_timer = false
+local node = math.tointeger(moon.get_env("NODE"))
+for _, c in ipairs(json.decode(moon.get_env("CONFIG"))) do
+    if c.node == node then
+        precise_timer = c.precise_timer
+    end
+end
+
+moon.async(function()
+    --- precise timers count from the real current time instead of the last update,
+    --- they neither fire early nor late by a whole update interval
+    for _, mills in ipairs({1, 3, 7, 15, 1, 3, 7, 15}) do
+        local start = moon.microseconds()
+        moon.sleep(mills)
+        local cost = (moon.microseconds() - start) // 1000
+        if precise_timer then
+            test_assert.greater_equal(cost, mills - 1)
+            test_assert.less(cost, mills + 5)
+        end
+    end
+
+    --- timers created in any order fire by deadline
+    local fired = {}
+    for _, mills in ipairs({9, 2, 5, 1, 7}) do
+        moon.repeated(mills, 1, function()
+            fired[#fired+1] = mills
+        end)
+    end
+    moon.sleep(20)
+    test_assert.linear_table_equal(fired, {1, 2, 5, 7, 9})
+
+    --- repeated timer keeps its own cadence
+    local ticks = 0
+    local start = moon.microseconds()
+    local stop = 0
+    moon.repeated(2, 10, function()
+        ticks = ticks + 1
+        if ticks == 10 then
+            stop = moon.microseconds()
+        end
+    end)
+    moon.sleep(40)
+    test_assert.equal(ticks, 10)
+    if precise_timer then
+        test_assert.greater_equal((stop - start) // 1000, 19)
+    end
+
+    test_assert.success()
+end)
@@ -0,0 +1,94 @@
+local moon = require("moon")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.subscriber then
+    local received = {}
+
+    if conf.topic then
+        moon.subscribe(conf.topic)
+    end
+
+    local command = {}
+
+    command.ANNOUNCE = function(_, _, text)
+        table.insert(received, text)
+    end
+
+    command.QUERY = function(sender, sessionid)
+        moon.response("lua", sender, sessionid, received)
+    end
+
+    command.UNSUBSCRIBE = function(sender, sessionid)
+        moon.unsubscribe(conf.topic)
+        moon.response("lua", sender, sessionid, true)
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, text = unpack(sz, len)
+        command[cmd](sender, sessionid, text)
+    end)
+    return
+end
+
+local services = {}
+
+moon.async(function()
+    local subscribers = {}
+    for i=1,3 do
+        subscribers[i] = moon.new_service("lua", {
+            name = "test_publish_subscriber",
+            file = "start_by_config/test_publish.lua",
+            subscriber = true,
+            topic = "announce"
+        })
+        table.insert(services, subscribers[i])
+    end
+
+    local other = moon.new_service("lua", {
+        name = "test_publish_other",
+        file = "start_by_config/test_publish.lua",
+        subscriber = true,
+        topic = "other"
+    })
+    table.insert(services, other)
+
+    --- publisher does not receive its own message
+    moon.subscribe("announce")
+    moon.dispatch('lua',function()
+        test_assert.assert(false, "publisher received its own message")
+    end)
+
+    moon.publish("lua", "announce", "ANNOUNCE", "hello")
+    moon.publish("lua", "announce", "ANNOUNCE", "world")
+    moon.publish("lua", "nobody", "ANNOUNCE", "lost")
+
+    for _, addr in ipairs(subscribers) do
+        local received = moon.co_call("lua", addr, "QUERY")
+        test_assert.equal(#received, 2)
+        test_assert.equal(received[1], "hello")
+        test_assert.equal(received[2], "world")
+    end
+    test_assert.equal(#moon.co_call("lua", other, "QUERY"), 0)
+
+    moon.co_call("lua", subscribers[1], "UNSUBSCRIBE")
+    moon.publish("lua", "announce", "ANNOUNCE", "again")
+    test_assert.equal(#moon.co_call("lua", subscribers[1], "QUERY"), 2)
+    test_assert.equal(#moon.co_call("lua", subscribers[2], "QUERY"), 3)
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    services = {}
+
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
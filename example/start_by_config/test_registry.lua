@@ -0,0 +1,71 @@
+local moon = require("moon")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.writer then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local key, value = unpack(sz, len)
+        moon.set_env(key, value)
+        moon.response("lua", sender, sessionid, true)
+    end)
+    return
+end
+
+local UNIQUE_NAME = "test_registry_unique"
+
+local services = {}
+
+moon.async(function()
+    --- another worker changes env, cached values of this service must follow
+    local writer = moon.new_service("lua", {
+        name = "test_registry_writer",
+        file = "start_by_config/test_registry.lua",
+        writer = true
+    })
+    table.insert(services, writer)
+
+    test_assert.equal(moon.get_env("test_registry_key"), "")
+    moon.co_call("lua", writer, "test_registry_key", "1")
+    test_assert.equal(moon.get_env("test_registry_key"), "1")
+    test_assert.equal(moon.get_env("test_registry_key"), "1")
+
+    local version = moon.registry_version()
+    moon.co_call("lua", writer, "test_registry_key", "2")
+    test_assert.assert(moon.registry_version() ~= version, "registry version not changed")
+    --- published before the response was handled, cached lookups compare against it
+    test_assert.equal(moon.registry_state.version, moon.registry_version())
+    test_assert.equal(moon.get_env("test_registry_key"), "2")
+
+    moon.set_env_pack("test_registry_pack", 1, "a", {x = 2})
+    local a, b, c = moon.get_env_unpack("test_registry_pack")
+    test_assert.equal(a, 1)
+    test_assert.equal(b, "a")
+    test_assert.equal(c.x, 2)
+
+    --- a cached miss is dropped once the unique service registers
+    test_assert.equal(moon.queryservice(UNIQUE_NAME), 0)
+    local unique = moon.new_service("lua", {
+        name = UNIQUE_NAME,
+        file = "start_by_config/test_registry.lua",
+        writer = true
+    }, true)
+    table.insert(services, unique)
+    test_assert.equal(moon.queryservice(UNIQUE_NAME), unique)
+    test_assert.equal(moon.queryservice(UNIQUE_NAME), unique)
+    test_assert.equal(moon.queryservice(unique), unique)
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    services = {}
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
@@ -0,0 +1,62 @@
+--- modules required by the pool are loaded before the service script runs
+local preloaded = package.loaded["base.set"] ~= nil
+
+local moon = require("moon")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+if conf.pooled then
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid = moon.decode(msg, "SE")
+        moon.response("lua", sender, sessionid, preloaded, moon.addr(), moon.name, type(require("base.set")))
+    end)
+    return
+end
+
+local POOL = "test_vm_pool"
+
+moon.async(function()
+    test_assert.equal(preloaded, false)
+    test_assert.assert(moon.vm_pool(POOL, 2, 0, {"base.set", "base.array"}))
+    test_assert.equal(moon.vm_pool(POOL, 2), false)
+    --- pools are filled while the worker is idle
+    moon.sleep(100)
+
+    local services = {}
+    --- takes more states than the pool holds, falls back to a fresh state when it is empty
+    for i = 1, 6 do
+        local addr = moon.new_service("lua", {
+            name = "test_vm_pool_" .. i,
+            file = "start_by_config/test_vm_pool.lua",
+            vmpool = POOL,
+            pooled = true
+        })
+        test_assert.assert(addr > 0, "create pooled service failed")
+        local loaded, id, name, settype = moon.co_call("lua", addr)
+        test_assert.equal(id, addr)
+        test_assert.equal(name, "test_vm_pool_" .. i)
+        test_assert.equal(settype, "table")
+        if i == 1 then
+            test_assert.equal(loaded, true)
+        end
+        services[#services+1] = addr
+    end
+
+    local plain = moon.new_service("lua", {
+        name = "test_vm_pool_plain",
+        file = "start_by_config/test_vm_pool.lua",
+        pooled = true
+    })
+    test_assert.equal(moon.co_call("lua", plain), false)
+    services[#services+1] = plain
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    moon.quit()
+end)
@@ -0,0 +1,115 @@
+local moon = require("moon")
+local json = require("json")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local NCOUNT = 5000
+
+if conf.worker then
+    local expect_seq = 1
+    local ticks = 0
+
+    moon.repeated(1, -1, function()
+        ticks = ticks + 1
+    end)
+
+    local command = {}
+
+    command.WORK = function(_, _, seq)
+        --messages must keep order, even if this service was moved to another worker
+        test_assert.equal(seq, expect_seq)
+        expect_seq = seq + 1
+        local n = 0
+        for i=1,2000 do
+            n = n + i
+        end
+    end
+
+    command.DONE = function(sender, sessionid)
+        moon.async(function()
+            local t = ticks
+            moon.sleep(50)
+            moon.response("lua", sender, sessionid, expect_seq - 1, ticks - t)
+        end)
+    end
+
+    moon.dispatch('lua',function(msg,unpack)
+        local sender, sessionid, sz, len = moon.decode(msg, "SEC")
+        local cmd, seq = unpack(sz, len)
+        command[cmd](sender, sessionid, seq)
+    end)
+    return
+end
+
+local thread_num = math.tointeger(moon.get_env("THREAD_NUM"))
+
+local work_stealing = false
+local node = math.tointeger(moon.get_env("NODE"))
+for _, c in ipairs(json.decode(moon.get_env("CONFIG"))) do
+    if c.node == node then
+        work_stealing = c.work_stealing
+    end
+end
+
+local services = {}
+
+moon.async(function()
+    if thread_num < 2 then
+        test_assert.success()
+        return
+    end
+
+    --- shared services are placed round-robin, find two of them sharing one worker
+    local placed = {}
+    local pair
+    for _=1,thread_num+1 do
+        local addr = moon.new_service("lua", {
+            name = "test_work_stealing_worker",
+            file = "start_by_config/test_work_stealing.lua",
+            worker = true
+        })
+        table.insert(services, addr)
+        local workerid = addr >> 24
+        if placed[workerid] then
+            pair = {placed[workerid], addr}
+            break
+        end
+        placed[workerid] = addr
+    end
+
+    test_assert.assert(pair, "can not place two services on one worker")
+
+    for seq=1,NCOUNT do
+        moon.send("lua", pair[1], "WORK", seq)
+        moon.send("lua", pair[2], "WORK", seq)
+    end
+
+    for _, addr in ipairs(pair) do
+        local n, ticks = moon.co_call("lua", addr, "DONE")
+        test_assert.equal(n, NCOUNT)
+        test_assert.greater(ticks, 0)
+    end
+
+    if work_stealing then
+        local stolen = 0
+        for i=1,thread_num do
+            stolen = stolen + json.decode(moon.wstate(i)).stolen
+        end
+        test_assert.greater(stolen, 0)
+    end
+
+    for _, addr in ipairs(services) do
+        moon.co_remove_service(addr)
+    end
+    services = {}
+
+    test_assert.success()
+end)
+
+moon.shutdown(function()
+    for _, addr in ipairs(services) do
+        moon.remove_service(addr)
+    end
+    moon.quit()
+end)
@@ -0,0 +1,129 @@
+local moon = require("moon")
+local socket = require("moon.socket")
+local test_assert = require("test_assert")
+
+local conf = ...
+
+local HOST = "127.0.0.1"
+local PORT = 30005
+local NCLIENT = 3
+
+--- tiny(7 bit length), medium(16 bit length) and large(64 bit length) frames
+local payloads = {
+    "hello",
+    string.rep("m", 300),
+    string.rep("l", 70000),
+}
+
+--- masked frames from the first client, sent in one burst so the server parses several per read
+local echoes = {
+    "echo from the first client",
+    "e",
+    string.rep("1", 17),
+    string.rep("2", 33),
+    string.rep("3", 300),
+    string.rep("4", 5000),
+    string.rep("5", 65535),
+}
+
+if conf.server then
+    local listenfd = socket.listen(HOST, PORT, moon.PTYPE_SOCKET_WS)
+    socket.start(listenfd)
+
+    local fds = {}
+
+    socket.wson("accept",function(fd)
+        table.insert(fds, fd)
+        if #fds < NCLIENT then
+            return
+        end
+        --- every payload encoded once, the same frame goes to all clients
+        for i, data in ipairs(payloads) do
+            local frame = socket.ws_frame(data, i == 1 and 16 or 0)
+            for _, v in ipairs(fds) do
+                test_assert.assert(socket.write_frame(v, frame))
+            end
+        end
+    end)
+
+    socket.wson("message",function(_, msg)
+        --- one message buffer written to all clients, must not be framed twice
+        for _, v in ipairs(fds) do
+            socket.write_message(v, msg)
+        end
+    end)
+
+    moon.shutdown(function()
+        socket.close(listenfd)
+        moon.quit()
+    end)
+    return
+end
+
+local server = 0
+local received = {}
+local finished = 0
+local first_fd
+
+socket.wson("connect",function(fd)
+    --- frames from a client must be masked, a shared frame is refused
+    test_assert.equal(socket.write_frame(fd, socket.ws_frame("client")), false)
+end)
+
+socket.wson("message",function(fd, msg)
+    local t = received[fd]
+    t[#t+1] = moon.decode(msg, "Z")
+    if #t == #payloads and fd == first_fd then
+        for _, data in ipairs(echoes) do
+            socket.write(fd, data)
+        end
+    end
+    if #t < #payloads + #echoes then
+        return
+    end
+
+    for i, data in ipairs(payloads) do
+        test_assert.equal(t[i], data)
+    end
+    for i, data in ipairs(echoes) do
+        test_assert.equal(t[#payloads + i], data)
+    end
+    received[fd] = nil
+    socket.close(fd)
+
+    finished = finished + 1
+    if finished == NCLIENT then
+        moon.async(function()
+            moon.co_remove_service(server)
+            server = 0
+            test_assert.success()
+        end)
+    end
+end)
+
+socket.wson("error",function(fd, msg)
+    --- closing a finished client reports an error too
+    test_assert.assert(not received[fd], moon.decode(msg, "Z"))
+end)
+
+moon.async(function()
+    server = moon.new_service("lua", {
+        name = "test_ws_frame_server",
+        file = "start_by_config/test_ws_frame.lua",
+        server = true
+    })
+
+    for _=1,NCLIENT do
+        local fd, err = socket.connect(HOST, PORT, moon.PTYPE_SOCKET_WS)
+        test_assert.assert(fd, err)
+        received[fd] = {}
+        first_fd = first_fd or fd
+    end
+end)
+
+moon.shutdown(function()
+    if server ~= 0 then
+        moon.remove_service(server)
+    end
+    moon.quit()
+end)
@@ -29,12 +29,16 @@ local co_resume = coroutine.resume
 local co_close = coroutine.close
 
 local _send = core.send
+local _publish = core.publish
 local _now = core.now
 local _addr = core.id
 local _remove_timer = core.remove_timer
 local _repeated = core.repeated
 local _newservice = core.new_service
 local _queryservice = core.queryservice
+local _get_env = core.get_env
+local _set_env = core.set_env
+local registry_state = core.registry_state
 local _decode = core.decode
 
 local unpack = seri.unpack
@@ -199,6 +203,23 @@ end
 
 core.callback(_default_dispatch)
 
+---@param msgs table @[2i-1] message*, [2i] PTYPE, [0] 正在处理的消息序号
+---@param first integer
+---@param last integer
+local function _batch_dispatch(msgs, first, last)
+    for i = first, last do
+        msgs[0] = i
+        _default_dispatch(msgs[2*i-1], msgs[2*i])
+    end
+end
+
+---开启/关闭批量分发: 工作者线程把连续发给本服务的多条消息合并成一次Lua调用, 减少高频小消息的调用开销。
+---某条消息处理出错只影响这一条(和逐条分发一样记录日志或者返回PTYPE_ERROR), 后面的消息照常处理
+---@param enable boolean
+function moon.batch_dispatch(enable)
+    core.batch_callback(enable and _batch_dispatch or nil)
+end
+
 ---
 ---向指定服务发送消息,消息内容会根据协议类型进行打包
 ---@param PTYPE string @协议类型
@@ -214,6 +235,21 @@ function moon.send(PTYPE, receiver, ...)
     return true
 end
 
+---向所有订阅了topic的服务广播消息(包括其它工作者线程上的服务,不包括自己), 消息内容会根据协议类型进行打包,
+---所有接收者共享同一份消息内容, 接收者可以用 moon.decode(msg, "H") 获取topic
+---@param PTYPE string @协议类型
+---@param topic string @主题, 使用 moon.subscribe(topic) 订阅
+---@return boolean
+function moon.publish(PTYPE, topic, ...)
+    local p = protocol[PTYPE]
+    if not p then
+        error(string.format("moon publish unknown PTYPE[%s] message", PTYPE))
+    end
+
+    _publish(topic, p.pack(...), p.PTYPE)
+    return true
+end
+
 ---向指定服务发送消息，消息内容不进行协议打包
 ---@param PTYPE string @协议类型
 ---@param receiver integer @接收者服务id
@@ -241,7 +277,11 @@ end
 
 ---async 创建一个新的服务
 ---@param stype string @服务类型，根据所注册的服务类型，可选有 'lua'
----@param config table @服务的启动配置，数据类型table, 可以用来向服务传递参数
+---@param config table @服务的启动配置，数据类型table, 可以用来向服务传递参数。
+---mailbox_limit 限制未处理消息数量, mailbox_policy 为超出时的策略: "reject"(默认, 拒绝新消息, call 返回错误),
+---"drop_oldest"(丢弃最旧的消息), "backpressure"(暂停读取该服务的网络连接, 直到消息处理到一半以下)
+---vmpool 从 moon.vm_pool 声明的虚拟机池取预先初始化的虚拟机, 池为空时和普通服务一样创建
+---arena=true 虚拟机使用独立的堆, 对象内存集中, 服务退出时整块释放(从虚拟机池取的虚拟机不使用)
 ---@param unique boolean @default false, 是否是唯一服务，唯一服务可以用moon.queryservice(name)查询服务id
 ---@param workerid integer @default 0 ,在指定工作者线程创建该服务，并绑定该线程。默认0,服务将轮询加入工作者线程。
 ---@return integer @返回服务id
@@ -288,22 +328,62 @@ function moon.quit()
     moon.remove_service(_addr)
 end
 
+--- unique服务和env很少改变, 查询结果缓存在本服务, registry版本变化时失效。
+--- 版本号在处理每条消息前更新: 其它服务的修改从下一条消息开始可见
+local registry_version = -1
+local unique_cache = {}
+local env_cache = {}
+
+local function check_registry()
+    local v = registry_state.version
+    if v ~= registry_version then
+        registry_version = v
+        unique_cache = {}
+        env_cache = {}
+    end
+end
+
 ---根据服务name获取服务id,注意只能查询创建时配置unique=true的服务
 ---@param name string
 ---@return integer @ 0 表示服务不存在
 function moon.queryservice(name)
 	if type(name)=='string' then
-		return _queryservice(name)
+		check_registry()
+		local id = unique_cache[name]
+		if not id then
+			id = _queryservice(name)
+			unique_cache[name] = id
+		end
+		return id
 	end
 	return name
 end
 
+---@param name string
+---@return string
+function moon.get_env(name)
+    check_registry()
+    local v = env_cache[name]
+    if not v then
+        v = _get_env(name)
+        env_cache[name] = v
+    end
+    return v
+end
+
+---@param name string
+---@param value string
+function moon.set_env(name, value)
+    _set_env(name, value)
+    env_cache[name] = nil
+end
+
 function moon.set_env_pack(name, ...)
-    return core.set_env(name, seri.packs(...))
+    return moon.set_env(name, seri.packs(...))
 end
 
 function moon.get_env_unpack(name)
-    return seri.unpack(core.get_env(name))
+    return seri.unpack(moon.get_env(name))
 end
 
 ---获取服务器时间, 可以调用 moon.adjtime 偏移时间
@@ -357,6 +437,24 @@ function moon.co_remove_service(serviceid)
     return moon.remove_service(serviceid, true)
 end
 
+---async
+---把服务迁移到另一个工作者线程, 服务id不变。定时器和订阅一起迁移, 迁移前发出的消息按原顺序在新线程处理。
+---拥有网络连接的服务不能迁移。被迁移的服务本身也可以调用, 迁移在当前消息处理完之后进行
+---@param serviceid integer
+---@param workerid integer @目标工作者线程
+---@return boolean, string|nil @失败时返回 false 和原因
+function moon.co_migrate(serviceid, workerid)
+    local sessionid = make_response()
+    core.migrate(serviceid, workerid, sessionid)
+    local res, err = co_yield()
+    if res == false then
+        return false, err
+    end
+    return true
+end
+
+---执行运行时命令, 例如 "worker.1.services" 查询工作者线程1的服务列表,
+---"worker.1.stats" 返回消息排队/处理耗时分布(json), "worker.1.metrics" 返回同样数据的 Prometheus 文本格式
 ---@param command string
 ---@return string
 function moon.co_runcmd(command)
@@ -385,6 +483,8 @@ function moon.co_call(PTYPE, receiver, ...)
 end
 
 ---回应moon.call
+---开启 mailbox_lanes 时应答消息优先处理: 应答可能比发送方在它之前发出的普通消息先到达,
+---需要顺序时等那些消息的结果, 或者让它们也走 call
 ---@param PTYPE string @协议类型
 ---@param receiver integer  @接收者服务id
 ---@param sessionid integer
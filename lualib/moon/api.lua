@@ -16,6 +16,9 @@ core.id = 0
 ---timezone
 core.timezone = 0
 
+---version: registry_version() 的值, 服务处理每条消息前更新, 读取不需要调用C函数
+core.registry_state = { version = 0 }
+
 ---return system microsecond.
 ---@return integer
 function core.microseconds()
@@ -105,11 +108,36 @@ function core.send(sender, receiver, data, header, sessionid)
     ignore_param(sender, receiver)
 end
 
+---向所有订阅了topic的服务广播消息, 消息内容由所有接收者共享
+---@param topic string
+---@param data string|userdata
+---@param type integer
+function core.publish(topic, data, type)
+    ignore_param(topic, data, type)
+end
+
+---当前服务订阅topic的广播消息
+---@param topic string
+function core.subscribe(topic)
+    ignore_param(topic)
+end
+
+---当前服务取消订阅topic
+---@param topic string
+function core.unsubscribe(topic)
+    ignore_param(topic)
+end
+
 --- remove a service
 function core.kill(addr, sessionid)
     ignore_param(addr, sessionid)
 end
 
+--- move a service to another worker
+function core.migrate(addr, workerid, sessionid)
+    ignore_param(addr, workerid, sessionid)
+end
+
 --- use for query framework info
 ---@param sender integer @
 ---@param cmd string
@@ -136,6 +164,28 @@ function core.get_env(key)
     ignore_param(key)
 end
 
+---env和unique服务的版本号, 任何一个改变时变化。可以用来缓存moon.queryservice, moon.get_env的结果
+---@return integer
+function core.registry_version()
+end
+
+---声明一个预先初始化的lua虚拟机池, 创建服务时配置 vmpool=name 的服务从池中取虚拟机, 跳过打开库和require公共模块。
+---每个工作者线程各自维护空闲虚拟机, 被取走后在工作者线程空闲时补充。modules中不能require "moon", 它绑定了具体服务。
+---服务退出时虚拟机直接释放, 不会放回池中
+---@param name string @池名字, 重复声明返回false
+---@param size integer @每个工作者线程最多空闲虚拟机数量
+---@param memlimit? integer @每个工作者线程空闲虚拟机最多占用内存(bytes), 0 不限制
+---@param modules? string[] @预先require的模块
+---@return boolean
+function core.vm_pool(name, size, memlimit, modules)
+    ignore_param(name, size, memlimit, modules)
+end
+
+---本服务lua虚拟机的内存(bytes)。创建服务时配置了 arena=true 的服务第二个返回值是独立堆从系统申请的内存
+---@return integer, integer|nil
+function core.memory()
+end
+
 ---get worker thread info
 ---@return string
 function core.wsate(workerid)
@@ -166,6 +216,18 @@ function core.callback(fn)
 
 end
 
+---set lua batch callback, nil disable batch dispatch. use moon.batch_dispatch
+---@param fn? fun(msgs:table,first:integer,last:integer)
+function core.batch_callback(fn)
+    ignore_param(fn)
+end
+
+--- get count of memory blocks the message and buffer pools requested from system
+---@return integer
+function core.pool_allocated()
+    -- body
+end
+
 --- get server time(milliseconds)
 ---@return integer
 function core.now()
@@ -301,6 +363,19 @@ function asio.listen(host, port, protocol)
     ignore_param(host, port, protocol)
 end
 
+---listen on every worker with SO_REUSEPORT, the kernel spreads accepts over the workers.
+---no need to call socket.start: connections are accepted at once and handed to owners in turn,
+---preferring the owners on the accepting worker. owners defaults to the calling service.
+---close the returned fd to close all listeners.
+---@param host string
+---@param port integer
+---@param protocol integer
+---@param owners integer[]|nil
+---@return integer
+function asio.listen_sharded(host, port, protocol, owners)
+    ignore_param(host, port, protocol, owners)
+end
+
 ---send data to fd, data string or userdata moon.buffer*
 ---@param fd integer
 ---@param data string|userdata
@@ -317,6 +392,23 @@ function asio.write_message(fd, m)
     ignore_param(fd, m)
 end
 
+---把数据编码成一个websocket帧(服务器端, 不带掩码), 只编码一次。
+---同一个帧可以用asio.write_frame发送给任意多个websocket连接, 不会复制数据。
+---@param data string|userdata
+---@param flag integer|nil @ 0(binary), 16(text), 32(ping), 64(pong)
+---@return userdata
+function asio.ws_frame(data, flag)
+    ignore_param(data, flag)
+end
+
+---发送asio.ws_frame创建的帧, 只能用于服务器端的websocket连接
+---@param fd integer
+---@param frame userdata
+---@return boolean
+function asio.write_frame(fd, frame)
+    ignore_param(fd, frame)
+end
+
 ---@param fd integer
 ---@param t integer 秒, 0不检测超时, 默认是0。
 ---@return boolean
@@ -338,6 +430,15 @@ function asio.set_enable_chunked(fd, flag)
     ignore_param(fd,flag)
 end
 
+---@param fd integer
+---@param mode string
+---PTYPE_SOCKET 协议的长度头: "u16"(默认, 2字节大端), "u32"(4字节大端), "varint"(LEB128, 1-5字节)。
+---u32, varint 的消息不拆分, 最大64MB。fd 为监听socket时, 作用于之后accept的连接。两端需要一致
+---@return boolean
+function asio.set_framing(fd, mode)
+    ignore_param(fd,mode)
+end
+
 ---@param fd integer
 function asio.close(fd)
     ignore_param(fd)
@@ -7,6 +7,8 @@ namespace moon
     constexpr int32_t WORKER_ID_SHIFT = 24;
     constexpr int64_t UPDATE_INTERVAL = 10; //ms
     constexpr int32_t BUFFER_HEAD_RESERVED = 14;//max : websocket header  max  len
+    constexpr int32_t STEAL_THRESHOLD = 256;//a worker with more queued messages may be stolen from
+    constexpr size_t MESSAGE_HEADER_INLINE = 24;//longer message headers are heap allocated
 
     DECLARE_UNIQUE_PTR(message);
 
@@ -25,6 +27,9 @@ namespace moon
     constexpr uint8_t PTYPE_SHUTDOWN = 8;//
     constexpr uint8_t PTYPE_TIMER = 9;//
 
+    //broadcast topic of service exit notification, subscribed by unique services
+    constexpr std::string_view TOPIC_SERVICE_EXIT = "_service_exit"sv;
+
     //network
     using message_size_t = uint16_t;
 
@@ -42,6 +47,7 @@ namespace moon
         ws_text = 1 << 4,
         ws_ping = 1 << 5,
         ws_pong = 1 << 6,
+        ws_frame = 1 << 7,//already encoded as a websocket frame
         buffer_flag_max,
     };
 
@@ -64,6 +70,14 @@ namespace moon
         both = 3,
     };
 
+    //length header of PTYPE_SOCKET frames, both ends must use the same
+    enum class frame_header :std::uint8_t
+    {
+        u16 = 0,//big endian, larger messages are chunked
+        u32 = 1,//big endian
+        varint = 2,//LEB128, 1 to 5 bytes
+    };
+
 }
 
 
@@ -1,15 +1,17 @@
 #pragma once
 #include "config.hpp"
 #include "common/buffer.hpp"
+#include "common/block_pool.hpp"
+#include "common/mpsc_queue.hpp"
 
 namespace moon
 {
-    class  message final
+    class  message final :public mpsc_queue_hook<message>
     {
     public:
         static buffer_ptr_t create_buffer(size_t capacity = 64, uint32_t headreserved = BUFFER_HEAD_RESERVED)
         {
-            return std::make_shared<buffer>(capacity, headreserved);
+            return std::allocate_shared<buffer>(pool_allocator<buffer>{}, capacity, headreserved);
         }
 
         static message_ptr_t create(size_t capacity = 64, uint32_t headreserved = BUFFER_HEAD_RESERVED)
@@ -23,9 +25,27 @@ namespace moon
             return std::make_unique<message>(std::forward<Buffer>(v));
         }
 
+        //blocks requested from the system by message and buffer pools
+        static size_t pool_allocated()
+        {
+            return block_pool<sizeof(message)>::allocated() + pool_allocator<buffer>::allocated();
+        }
+
+        static void* operator new(size_t size)
+        {
+            (void)size;
+            assert(size == sizeof(message));
+            return block_pool<sizeof(message)>::allocate();
+        }
+
+        static void operator delete(void* p)
+        {
+            block_pool<sizeof(message)>::deallocate(p);
+        }
+
         message(size_t capacity = 64, uint32_t headreserved = 0)
         {
-            data_ = std::make_shared<buffer>(capacity, headreserved);
+            data_ = create_buffer(capacity, headreserved);
         }
 
         template<typename Buffer, std::enable_if_t<std::is_same_v<std::decay_t<Buffer>, buffer_ptr_t>, int> = 0>
@@ -67,13 +87,17 @@ namespace moon
         {
             if (header.size() != 0)
             {
-                if (!header_)
+                header_size_ = static_cast<uint32_t>(header.size());
+                if (header.size() <= MESSAGE_HEADER_INLINE)
+                {
+                    memcpy(header_inline_, header.data(), header.size());
+                }
+                else if (!header_)
                 {
                     header_ = std::make_unique<std::string>(header);
                 }
                 else
                 {
-                    header_->clear();
                     header_->assign(header);
                 }
             }
@@ -81,14 +105,11 @@ namespace moon
 
         std::string_view header() const
         {
-            if (nullptr == header_)
+            if (header_size_ <= MESSAGE_HEADER_INLINE)
             {
-                return std::string_view{};
-            }
-            else
-            {
-                return std::string_view{ *header_ };
+                return std::string_view{ header_inline_, header_size_ };
             }
+            return std::string_view{ *header_ };
         }
 
         void set_sessionid(int32_t v)
@@ -156,6 +177,28 @@ namespace moon
             return data_ ? data_.get() : nullptr;
         }
 
+        //time pushed to the receiver's mailbox, microseconds
+        void set_enqueue_time(int64_t v)
+        {
+            enqueue_time_ = v;
+        }
+
+        int64_t enqueue_time() const
+        {
+            return enqueue_time_;
+        }
+
+        //counted in a bounded mailbox, see worker::admit
+        void set_mailbox_counted(bool v)
+        {
+            mailbox_counted_ = v;
+        }
+
+        bool mailbox_counted() const
+        {
+            return mailbox_counted_;
+        }
+
         bool broadcast() const
         {
             return data_?data_->has_flag(buffer_flag::broadcast):false;
@@ -176,11 +219,9 @@ namespace moon
             sender_ = 0;
             receiver_ = 0;
             sessionid_ = 0;
-
-            if (header_)
-            {
-                header_->clear();
-            }
+            header_size_ = 0;
+            enqueue_time_ = 0;
+            mailbox_counted_ = false;
 
             if (data_)
             {
@@ -189,9 +230,14 @@ namespace moon
         }
     private:
         uint8_t type_ = 0;
+        bool mailbox_counted_ = false;
         uint32_t sender_ = 0;
         uint32_t receiver_ = 0;
         int32_t sessionid_ = 0;
+        uint32_t header_size_ = 0;
+        int64_t enqueue_time_ = 0;
+        //short headers are stored inline, longer ones in header_
+        char header_inline_[MESSAGE_HEADER_INLINE];
         std::unique_ptr<std::string> header_;
         buffer_ptr_t data_;
     };
@@ -5,13 +5,14 @@
 #include "const_buffers_holder.hpp"
 #include "common/string.hpp"
 #include "error.hpp"
+#include "tcp_socket.hpp"
 
 namespace moon
 {
     class base_connection :public std::enable_shared_from_this<base_connection>
     {
     public:
-        using socket_t = asio::ip::tcp::socket;
+        using socket_t = moon::tcp_socket;
 
         using message_handler_t = std::function<void(const message_ptr_t&)>;
 
@@ -49,31 +50,7 @@ namespace moon
             {
                 return false;
             }
-
-            if (!socket_.is_open())
-            {
-                return false;
-            }
-
-            queue_.emplace_back(std::move(data));
-
-            if (wq_warn_size_ != 0 && queue_.size() >= wq_warn_size_)
-            {
-                CONSOLE_WARN(logger(), "network send queue too long. size:%zu", queue_.size());
-                if (wq_error_size_ != 0 && queue_.size() >= wq_error_size_)
-                {
-                    asio::post(socket_.get_executor(), [this, self = shared_from_this()]() {
-                        error(make_error_code(moon::error::send_queue_too_big));
-                    });
-                    return false;
-                }
-            }
-
-            if (!sending_)
-            {
-                post_send();
-            }
-            return true;
+            return enqueue(std::move(data));
         }
 
         void close()
@@ -106,8 +83,18 @@ namespace moon
             return fd_;
         }
 
+        uint32_t owner() const
+        {
+            return serviceid_;
+        }
+
         void timeout(time_t now)
         {
+            if (read_deferred_)
+            {
+                return;
+            }
+
             if ((0 != timeout_) && (0 != recvtime_) && (now - recvtime_ > timeout_))
             {
                 asio::post(socket_.get_executor(), [this]() {
@@ -146,6 +133,17 @@ namespace moon
             wq_error_size_ = errorsize;
         }
 
+        //continue a read deferred by read_paused()
+        void resume_read()
+        {
+            if (read_deferred_)
+            {
+                read_deferred_ = false;
+                recvtime_ = now();
+                on_resume_read();
+            }
+        }
+
         static time_t now()
         {
             return std::time(nullptr);
@@ -165,12 +163,74 @@ namespace moon
             return address;
         }
     protected:
+        //owner's mailbox is full: defer the next read until socket::resume_read
+        bool read_paused()
+        {
+            if (nullptr != parent_ && parent_->read_paused(serviceid_))
+            {
+                read_deferred_ = true;
+                return true;
+            }
+            return false;
+        }
+
+        virtual void on_resume_read()
+        {
+        }
+
         virtual void message_slice(const_buffers_holder& holder, const buffer_ptr_t& buf)
         {
             (void)holder;
             (void)buf;
         }
 
+        //queue a buffer that is ready to be written, a header may still be added by push_buffer
+        bool enqueue(buffer_ptr_t data)
+        {
+            if (!socket_.is_open())
+            {
+                return false;
+            }
+
+            queue_.emplace_back(std::move(data));
+
+            if (wq_warn_size_ != 0 && queue_.size() >= wq_warn_size_)
+            {
+                CONSOLE_WARN(logger(), "network send queue too long. size:%zu", queue_.size());
+                if (wq_error_size_ != 0 && queue_.size() >= wq_error_size_)
+                {
+                    asio::post(socket_.get_executor(), [this, self = shared_from_this()]() {
+                        error(make_error_code(moon::error::send_queue_too_big));
+                    });
+                    return false;
+                }
+            }
+
+            if (!sending_)
+            {
+                //flush on the next turn of the event loop, writes queued meanwhile share one writev
+                sending_ = true;
+                asio::post(socket_.get_executor(), [this, self = shared_from_this()]() {
+                    sending_ = false;
+                    post_send();
+                });
+            }
+            return true;
+        }
+
+        //add a queued buffer to the next write
+        virtual void push_buffer(const_buffers_holder& holder, const buffer_ptr_t& buf)
+        {
+            if (buf->has_flag(buffer_flag::chunked))
+            {
+                message_slice(holder, buf);
+            }
+            else
+            {
+                holder.push_back(buf->data(), buf->size(), buf->has_flag(buffer_flag::close));
+            }
+        }
+
         void post_send()
         {
             if (queue_.size() == 0)
@@ -178,14 +238,7 @@ namespace moon
 
             for (const auto& buf : queue_)
             {
-                if (buf->has_flag(buffer_flag::chunked))
-                {
-                    message_slice(holder_, buf);
-                }
-                else
-                {
-                    holder_.push_back(buf->data(), buf->size(), buf->has_flag(buffer_flag::close));
-                }
+                push_buffer(holder_, buf);
 
                 if (holder_.size() >= const_buffers_holder::max_count)
                 {
@@ -283,6 +336,7 @@ namespace moon
         }
     protected:
         bool sending_ = false;
+        bool read_deferred_ = false;
         uint32_t fd_ = 0;
         time_t recvtime_ = 0;
         uint32_t timeout_ = 0;
@@ -1,21 +1,49 @@
 #pragma once
 #include "config.hpp"
 #include "common/buffer.hpp"
+#include "common/block_pool.hpp"
 #include "asio.hpp"
+#include <array>
 
 namespace moon
 {
+    /*
+        Gathers queued buffers into one scatter/gather write.
+        Runs of small buffers and chunk headers are copied into a staging block and share
+        one iovec, a lone small buffer and larger payloads are referenced in place.
+        The staging block is pooled and only held while a write is in flight.
+    */
     class const_buffers_holder
     {
+        static constexpr size_t staging_size = 4096;
+
+        using staging_pool = block_pool<staging_size>;
     public:
+        //iovecs per write
         static constexpr size_t max_count = 64;
+        //buffers up to this size are copied into the staging block
+        static constexpr size_t coalesce_size = 256;
+        //longest length header in front of a buffer
+        static constexpr size_t max_header_size = 8;
 
         const_buffers_holder() = default;
 
+        const_buffers_holder(const const_buffers_holder&) = delete;
+
+        const_buffers_holder& operator=(const const_buffers_holder&) = delete;
+
+        ~const_buffers_holder()
+        {
+            staging_pool::deallocate(staging_);
+        }
+
         void push_back(const char* data, size_t len, bool close)
         {
             close_ = close ? true : close_;
-            buffers_.emplace_back(data, len);
+            if (len > coalesce_size || !coalesce(data, len))
+            {
+                buffers_.emplace_back(data, len);
+            }
             ++count_;
         }
 
@@ -24,12 +52,26 @@ namespace moon
             ++count_;
         }
 
+        //a length header written in front of the next buffer, not counted as a buffer
+        void push_header(const void* header, size_t len)
+        {
+            assert(len <= max_header_size);
+            if (!stage(static_cast<const char*>(header), len))
+            {
+                auto& value = headers_.emplace_front();
+                memcpy(value.data(), header, len);
+                buffers_.emplace_back(value.data(), len);
+            }
+        }
+
         void push_slice(message_size_t header, const char* data, size_t len)
         {
-            headers_.emplace_front(header);
-            message_size_t& value = headers_.front();
-            buffers_.emplace_back(reinterpret_cast<const char*>(&value), sizeof(value));
-            buffers_.emplace_back(data, len);
+            push_header(&header, sizeof(header));
+
+            if (len > coalesce_size || !coalesce(data, len))
+            {
+                buffers_.emplace_back(data, len);
+            }
         }
 
         const auto& buffers() const
@@ -52,19 +94,78 @@ namespace moon
         {
             close_ = false;
             count_ = 0;
+            staged_ = 0;
             buffers_.clear();
             headers_.clear();
+            staging_pool::deallocate(staging_);
+            staging_ = nullptr;
         }
 
         bool close() const
         {
             return close_;
         }
+    private:
+        //append to a run of small buffers, starting the run copies the previous one too
+        bool coalesce(const char* data, size_t len)
+        {
+            if (buffers_.empty())
+            {
+                return false;
+            }
+
+            auto last = buffers_.back();
+            const char* p = static_cast<const char*>(last.data());
+            bool staged = (nullptr != staging_ && p >= staging_ && p < staging_ + staged_);
+            if (!staged)
+            {
+                if (last.size() > coalesce_size || staged_ + last.size() + len > staging_size)
+                {
+                    return false;
+                }
+                buffers_.pop_back();
+                stage(p, last.size());
+            }
+            return stage(data, len);
+        }
+
+        bool stage(const char* data, size_t len)
+        {
+            if (staged_ + len > staging_size)
+            {
+                return false;
+            }
+
+            if (nullptr == staging_)
+            {
+                staging_ = static_cast<char*>(staging_pool::allocate());
+            }
+
+            char* dst = staging_ + staged_;
+            memcpy(dst, data, len);
+            staged_ += len;
+
+            //extend the previous iovec if it ends right here
+            if (!buffers_.empty())
+            {
+                auto& last = buffers_.back();
+                if (static_cast<const char*>(last.data()) + last.size() == dst)
+                {
+                    last = asio::const_buffer(last.data(), last.size() + len);
+                    return true;
+                }
+            }
+            buffers_.emplace_back(dst, len);
+            return true;
+        }
     private:
         bool close_ = false;
         size_t count_ = 0;
+        size_t staged_ = 0;
+        char* staging_ = nullptr;
         std::vector<asio::const_buffer> buffers_;
-        std::forward_list< message_size_t> headers_;
+        //headers that did not fit in the staging block
+        std::forward_list<std::array<char, max_header_size>> headers_;
     };
 
     /*
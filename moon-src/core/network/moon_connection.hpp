@@ -9,6 +9,12 @@ namespace moon
     public:
         static constexpr message_size_t MASK_CONTINUED = 1<<(sizeof(message_size_t)*8-1);
         static constexpr message_size_t MAX_CHUNK_SIZE = MASK_CONTINUED ^ std::numeric_limits<message_size_t>::max();
+        static constexpr size_t RECV_BUFFER_SIZE = 8192;
+        //a frame this large that ends the receive buffer is handed over with it instead of copied
+        static constexpr size_t HANDOFF_SIZE = RECV_BUFFER_SIZE / 2;
+        //largest message of the u32 and varint frame headers
+        static constexpr size_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+        static constexpr size_t MAX_VARINT_SIZE = 5;
 
         using base_connection_t = base_connection;
 
@@ -16,7 +22,6 @@ namespace moon
         explicit moon_connection(Args&&... args)
             :base_connection(std::forward<Args>(args)...)
             , flag_(enable_chunked::none)
-            , header_(0)
         {
         }
 
@@ -28,11 +33,37 @@ namespace moon
             m->set_receiver(static_cast<uint8_t>(accepted ?
                 socket_data_type::socket_accept : socket_data_type::socket_connect));
             handle_message(std::move(m));
-            read_header();
+            read_some();
         }
 
         bool send(buffer_ptr_t data) override
         {
+            if (data == nullptr)
+            {
+                return false;
+            }
+
+            //a websocket frame is shared with other connections, must not be framed again
+            if (data->has_flag(buffer_flag::ws_frame))
+            {
+                return false;
+            }
+
+            //the header goes in front of the buffer when it is written, see push_buffer
+            if (frame_header_ != frame_header::u16)
+            {
+                size_t size = data->size() - (data->has_flag(buffer_flag::pack_size) ? sizeof(message_size_t) : 0);
+                if (size > MAX_FRAME_SIZE)
+                {
+                    asio::post(socket_.get_executor(), [this, self = shared_from_this()]() {
+                        error(make_error_code(moon::error::write_message_too_big));
+                    });
+                    return false;
+                }
+                //an empty message is a header alone
+                return enqueue(std::move(data));
+            }
+
             if (!data->has_flag(buffer_flag::pack_size))
             {
                 if (data->size() > MAX_CHUNK_SIZE)
@@ -63,7 +94,57 @@ namespace moon
         {
             flag_ = v;
         }
+
+        void set_frame_header(frame_header v)
+        {
+            frame_header_ = v;
+        }
     protected:
+        void push_buffer(const_buffers_holder& holder, const buffer_ptr_t& buf) override
+        {
+            if (frame_header_ == frame_header::u16)
+            {
+                base_connection_t::push_buffer(holder, buf);
+                return;
+            }
+
+            //buffers are not changed: one may be queued on connections with other headers too,
+            //one of which has already put its 16-bit header in front
+            const char* data = buf->data();
+            size_t size = buf->size();
+            if (buf->has_flag(buffer_flag::pack_size))
+            {
+                data += sizeof(message_size_t);
+                size -= sizeof(message_size_t);
+            }
+
+            uint8_t header[MAX_VARINT_SIZE];
+            size_t n = 0;
+            if (frame_header_ == frame_header::u32)
+            {
+                uint32_t value = static_cast<uint32_t>(size);
+                host2net(value);
+                memcpy(header, &value, sizeof(value));
+                n = sizeof(value);
+            }
+            else
+            {
+                size_t value = size;
+                do
+                {
+                    header[n] = static_cast<uint8_t>(value & 0x7F);
+                    value >>= 7;
+                    if (value != 0)
+                    {
+                        header[n] |= 0x80;
+                    }
+                    ++n;
+                } while (value != 0);
+            }
+            holder.push_header(header, n);
+            holder.push_back(data, size, buf->has_flag(buffer_flag::close));
+        }
+
         void message_slice(const_buffers_holder& holder, const buffer_ptr_t& buf) override
         {
             size_t n = buf->size();
@@ -87,9 +168,32 @@ namespace moon
             } while (n != 0);
         }
 
-        void read_header()
+        void on_resume_read() override
+        {
+            //frames left in the receive buffer when the owner's mailbox filled up go first
+            if (parse())
+            {
+                read_some();
+            }
+        }
+
+        //read what the socket has, up to the free space of the receive buffer, and parse every frame in it
+        void read_some()
         {
-            asio::async_read(socket_, asio::buffer(&header_, sizeof(header_)),
+            if (read_paused())
+            {
+                return;
+            }
+
+            if (nullptr == rbuf_)
+            {
+                rbuf_ = message::create_buffer(RECV_BUFFER_SIZE);
+            }
+            rbuf_->prepare(std::max(need_, RECV_BUFFER_SIZE / 2));
+
+            //the rest of a large frame alone, so that the buffer can be handed over with it
+            size_t n = (need_ >= HANDOFF_SIZE) ? need_ : rbuf_->writeablesize();
+            socket_.async_read_some(asio::buffer(rbuf_->data() + rbuf_->size(), n),
                     [this, self = shared_from_this()](const asio::error_code& e, std::size_t bytes_transferred)
             {
                 if (e)
@@ -98,77 +202,174 @@ namespace moon
                     return;
                 }
 
-                if (bytes_transferred == 0)
+                recvtime_ = now();
+                rbuf_->commit(bytes_transferred);
+                if (parse())
                 {
-                    read_header();
-                    return;
+                    read_some();
                 }
+            });
+        }
 
-                recvtime_ = now();
-                net2host(header_);
+        //false when the connection got an error or was closed by its owner.
+        //stops with frames left when the owner's mailbox is full, on_resume_read parses them
+        bool parse()
+        {
+            need_ = 0;
+            //rbuf_ is null once a frame took it
+            while (nullptr != rbuf_ && rbuf_->size() != 0)
+            {
+                if (read_paused())
+                {
+                    break;
+                }
 
-                bool enable = (static_cast<int>(flag_)&static_cast<int>(enable_chunked::receive)) != 0;
+                size_t size = 0;
                 bool fin = true;
-                if (enable)
+                int n = read_frame_header(size, fin);
+                if (n < 0)
                 {
-                    //check is continued message
-                    fin = ((header_ & MASK_CONTINUED) == 0);
-                    if (!fin)
-                    {
-                        header_ &= MAX_CHUNK_SIZE;
-                    }
+                    error(make_error_code(moon::error::read_message_too_big));
+                    return false;
                 }
 
-                if (header_ > MAX_CHUNK_SIZE)
+                if (n == 0)
                 {
-                    error(make_error_code(moon::error::read_message_too_big));
-                    return;
+                    break;
                 }
-                read_body(header_, fin);
-            });
+
+                size_t readable = rbuf_->size() - n;
+                if (readable < size)
+                {
+                    need_ = size - readable;
+                    break;
+                }
+
+                rbuf_->consume(n);
+                on_frame(size, fin);
+                if (!socket_.is_open())
+                {
+                    return false;
+                }
+            }
+            return true;
         }
 
-        void read_body(message_size_t size, bool fin)
+        //bytes of the frame header at the front of rbuf_, 0 if it is incomplete, -1 if the frame is too large
+        int read_frame_header(size_t& size, bool& fin) const
         {
-            if (nullptr == buf_)
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(rbuf_->data());
+            size_t len = rbuf_->size();
+            switch (frame_header_)
             {
-                buf_ = message::create_buffer(fin ? size: 5 * size);
-            }
-            else
+            case frame_header::u32:
             {
-                buf_->prepare(size);
+                uint32_t value = 0;
+                if (len < sizeof(value))
+                {
+                    return 0;
+                }
+                memcpy(&value, p, sizeof(value));
+                net2host(value);
+                size = value;
+                return (size > MAX_FRAME_SIZE) ? -1 : static_cast<int>(sizeof(value));
             }
+            case frame_header::varint:
+            {
+                size_t n = 0;
+                while (true)
+                {
+                    if (n == len)
+                    {
+                        return 0;
+                    }
+
+                    if (n == MAX_VARINT_SIZE)
+                    {
+                        return -1;
+                    }
 
-            asio::async_read(socket_, asio::buffer((buf_->data() + buf_->size()), size),
-                    [this, self = shared_from_this(), fin](const asio::error_code& e, std::size_t bytes_transferred)
+                    uint8_t b = p[n];
+                    size |= static_cast<size_t>(b & 0x7F) << (7 * n);
+                    ++n;
+                    if ((b & 0x80) == 0)
+                    {
+                        break;
+                    }
+                }
+                return (size > MAX_FRAME_SIZE) ? -1 : static_cast<int>(n);
+            }
+            default:
             {
-                if (e)
+                message_size_t header = 0;
+                if (len < sizeof(header))
                 {
-                    error(e);
-                    return;
+                    return 0;
                 }
+                memcpy(&header, p, sizeof(header));
+                net2host(header);
 
-                if (bytes_transferred == 0)
+                bool enable = (static_cast<int>(flag_)&static_cast<int>(enable_chunked::receive)) != 0;
+                if (enable)
                 {
-                    read_header();
-                    return;
+                    //check is continued message
+                    fin = ((header & MASK_CONTINUED) == 0);
+                    if (!fin)
+                    {
+                        header &= MAX_CHUNK_SIZE;
+                    }
                 }
+                size = header;
+                return (header > MAX_CHUNK_SIZE) ? -1 : static_cast<int>(sizeof(header));
+            }
+            }
+        }
 
-                buf_->commit(static_cast<int>(bytes_transferred));
-                if (fin)
+        void on_frame(size_t size, bool fin)
+        {
+            if (fin && nullptr == buf_)
+            {
+                buffer_ptr_t data;
+                if (rbuf_->size() == size && size >= HANDOFF_SIZE)
                 {
-                    auto m = message::create(std::move(buf_));
-                    m->set_receiver(static_cast<uint8_t>(socket_data_type::socket_recv));
-                    handle_message(std::move(m));
+                    //last frame in the receive buffer, the message takes the buffer instead of a copy
+                    data = std::move(rbuf_);
                 }
+                else
+                {
+                    data = message::create_buffer(size);
+                    data->write_back(rbuf_->data(), size);
+                    rbuf_->consume(size);
+                }
+                auto m = message::create(std::move(data));
+                m->set_receiver(static_cast<uint8_t>(socket_data_type::socket_recv));
+                handle_message(std::move(m));
+                return;
+            }
 
-                read_header();
-            });
+            if (nullptr == buf_)
+            {
+                buf_ = message::create_buffer(fin ? size : 5 * size);
+            }
+            buf_->write_back(rbuf_->data(), size);
+            rbuf_->consume(size);
+
+            if (fin)
+            {
+                auto m = message::create(std::move(buf_));
+                m->set_receiver(static_cast<uint8_t>(socket_data_type::socket_recv));
+                handle_message(std::move(m));
+            }
         }
 
     protected:
         enable_chunked flag_;
-        message_size_t header_;
+        frame_header frame_header_ = frame_header::u16;
+        //bytes of the next frame still to come
+        size_t need_ = 0;
+        //chunks of a message received so far
         buffer_ptr_t buf_;
+        //received bytes not parsed yet
+        buffer_ptr_t rbuf_;
     };
 }
\ No newline at end of file
@@ -61,6 +61,7 @@ uint32_t socket::listen(const std::string & host, uint16_t port, uint32_t owner,
         auto id = uuid();
         ctx->fd = id;
         acceptors_.emplace(id, ctx);
+        own(ctx, true);
         return id;
     }
     catch (asio::system_error& e)
@@ -70,7 +71,135 @@ uint32_t socket::listen(const std::string & host, uint16_t port, uint32_t owner,
     }
 }
 
+uint32_t socket::listen_sharded(const std::string& host, uint16_t port, uint32_t owner, uint8_t type, std::vector<uint32_t> owners)
+{
+    if (owners.empty())
+    {
+        owners.push_back(owner);
+    }
+
+    try
+    {
+        asio::ip::tcp::resolver resolver(ioc_);
+        asio::ip::tcp::endpoint endpoint = *resolver.resolve(host, std::to_string(port)).begin();
+
+        //all listeners are bound here, so that an error is returned to the caller
+        std::vector<std::pair<worker*, acceptor_context_ptr_t>> shards;
+        for (auto& w : router_->get_server()->get_workers())
+        {
+            auto ctx = std::make_shared<socket::acceptor_context>(type, owner, w->io_context());
+            ctx->owners = owners;
+            ctx->sharded = true;
+            ctx->acceptor.open(endpoint.protocol());
+#if TARGET_PLATFORM != PLATFORM_WINDOWS
+            ctx->acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#endif
+#ifdef SO_REUSEPORT
+            ctx->acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+            ctx->acceptor.bind(endpoint);
+            ctx->acceptor.listen(std::numeric_limits<int>::max());
+            shards.emplace_back(w.get(), std::move(ctx));
+#ifndef SO_REUSEPORT
+            //the port can not be shared, one listener for all
+            break;
+#endif
+        }
+
+        auto id = uuid();
+        for (auto& [w, ctx] : shards)
+        {
+            ctx->fd = id;
+            if (w == worker_)
+            {
+                start_shard(ctx);
+            }
+            else
+            {
+                asio::post(w->io_context(), [w = w, ctx = ctx] {
+                    w->socket().start_shard(ctx);
+                });
+            }
+        }
+        return id;
+    }
+    catch (asio::system_error& e)
+    {
+        CONSOLE_ERROR(router_->logger(), "%s:%d %s(%d)", host.data(), port, e.what(), e.code().value());
+        return 0;
+    }
+}
+
+void socket::start_shard(const acceptor_context_ptr_t& ctx)
+{
+    acceptors_.emplace(ctx->fd, ctx);
+    own(ctx, true);
+
+    //owners on this worker take its connections without a hop to another thread
+    for (auto owner : ctx->owners)
+    {
+        if (nullptr != find_service(owner))
+        {
+            ctx->targets.emplace_back(owner, worker_);
+        }
+    }
+
+    if (!ctx->targets.empty())
+    {
+        accept_next(ctx);
+        return;
+    }
+
+    //an owner may run on another worker than the one in its id, it stays there while it owns the listener
+    auto pending = std::make_shared<size_t>(ctx->owners.size());
+    for (auto owner : ctx->owners)
+    {
+        auto on_located = [this, ctx, owner, pending](worker* w) {
+            asio::post(ioc_, [this, ctx, owner, pending, w] {
+                if (nullptr != w)
+                {
+                    ctx->targets.emplace_back(owner, w);
+                }
+
+                if (--(*pending) != 0)
+                {
+                    return;
+                }
+
+                if (ctx->targets.empty())
+                {
+                    CONSOLE_WARN(router_->logger(), "socket::listen_sharded fd %u: no owner is running", ctx->fd);
+                    return;
+                }
+                accept_next(ctx);
+            });
+        };
+
+        if (worker* home = router_->get_server()->get_worker(router_->worker_id(owner)); nullptr != home)
+        {
+            home->locate_service(owner, std::move(on_located));
+        }
+        else
+        {
+            on_located(nullptr);
+        }
+    }
+}
+
+void socket::accept_next(const acceptor_context_ptr_t& ctx)
+{
+    const auto& [owner, w] = ctx->targets[ctx->next_target++ % ctx->targets.size()];
+    accept(ctx->fd, 0, owner, w);
+}
+
 void socket::accept(uint32_t fd, int32_t sessionid, uint32_t owner)
+{
+    //owner may be moved away from the worker encoded in its id
+    worker* w = (nullptr != find_service(owner)) ? worker_ : router_->get_server()->get_worker(router_->worker_id(owner));
+    accept(fd, sessionid, owner, w);
+}
+
+void socket::accept(uint32_t fd, int32_t sessionid, uint32_t owner, worker* w)
 {
     assert(owner > 0 && "socket::accept : invalid serviceid");
     auto iter = acceptors_.find(fd);
@@ -86,13 +215,17 @@ void socket::accept(uint32_t fd, int32_t sessionid, uint32_t owner)
         return;
     }
 
-    worker* w = router_->get_server()->get_worker(router_->worker_id(owner));
     auto c = w->socket().make_connection(owner, ctx->type);
 
-    ctx->acceptor.async_accept(c->socket(), [this, ctx, c, w, sessionid, owner](const asio::error_code& e)
+    auto on_accept = [this, ctx, c, w, sessionid, owner](const asio::error_code& e)
     {
         if (!e)
         {
+            accept_count_.fetch_add(1, std::memory_order_relaxed);
+            if (ctx->type == PTYPE_SOCKET)
+            {
+                std::static_pointer_cast<moon_connection>(c)->set_frame_header(ctx->framing);
+            }
             c->fd(w->socket().uuid());
             w->socket().add_connection(this, ctx, c, sessionid);
         }
@@ -113,9 +246,47 @@ void socket::accept(uint32_t fd, int32_t sessionid, uint32_t owner)
 
         if (sessionid == 0)
         {
-            accept(ctx->fd, sessionid, owner);
+            if (ctx->targets.empty())
+            {
+                accept(ctx->fd, sessionid, owner, w);
+            }
+            else
+            {
+                accept_next(ctx);
+            }
         }
-    });
+    };
+
+#ifdef MOON_ENABLE_IO_URING
+    if (nullptr != worker_->uring_)
+    {
+        auto op = worker_->uring_->make_op([ctx, c, on_accept = std::move(on_accept)](int res) mutable {
+            ctx->accept_op = nullptr;
+            asio::error_code ec = uring::make_error(res);
+            if (!ec)
+            {
+                auto protocol = ctx->acceptor.local_endpoint(ec).protocol();
+                if (!ec)
+                {
+                    c->socket().lowest_layer().assign(protocol, res, ec);
+                }
+
+                if (ec)
+                {
+                    ::close(res);
+                }
+            }
+            on_accept(ec);
+        });
+        io_uring_sqe* sqe = worker_->uring_->prepare(op);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = ctx->acceptor.native_handle();
+        sqe->accept_flags = SOCK_CLOEXEC;
+        ctx->accept_op = op;
+        return;
+    }
+#endif
+    ctx->acceptor.async_accept(c->socket().lowest_layer(), std::move(on_accept));
 }
 
 int socket::connect(const std::string& host, uint16_t port, uint32_t owner, uint8_t type, int32_t sessionid, int32_t timeout)
@@ -129,9 +300,10 @@ int socket::connect(const std::string& host, uint16_t port, uint32_t owner, uint
 
         if (0 == sessionid)
         {
-            asio::connect(c->socket(), endpoints);
+            asio::connect(c->socket().lowest_layer(), endpoints);
             c->fd(uuid());
             connections_.emplace(c->fd(), c);
+            own(owner);
             asio::post(ioc_, [c]() {
                 c->start(false);
              });
@@ -157,13 +329,14 @@ int socket::connect(const std::string& host, uint16_t port, uint32_t owner, uint
                 });
             }
 
-            asio::async_connect(c->socket(), endpoints,
+            asio::async_connect(c->socket().lowest_layer(), endpoints,
                 [this, c, host, port, owner, sessionid](const asio::error_code& e, const asio::ip::tcp::endpoint&)
             {
                 if (!e)
                 {
                     c->fd(uuid());
                     connections_.emplace(c->fd(), c);
+                    own(owner);
                     c->start(false);
                     response(0, owner, std::to_string(c->fd()), std::string_view{}, sessionid, PTYPE_TEXT);
                 }
@@ -225,11 +398,18 @@ bool socket::write_message(uint32_t fd, void * m)
     return write(fd, *msg);
 }
 
+buffer_ptr_t socket::make_ws_frame(buffer_ptr_t data, buffer_flag flag)
+{
+    data->set_flag(flag);
+    return ws_connection::make_frame(std::move(data));
+}
+
 bool socket::close(uint32_t fd)
 {
     if (auto iter = connections_.find(fd); iter != connections_.end())
     {
         iter->second->close();
+        disown(iter->second->owner());
         connections_.erase(iter);
         unlock_fd(fd);
         return true;
@@ -239,10 +419,38 @@ bool socket::close(uint32_t fd)
     {
         if (iter->second->acceptor.is_open())
         {
+#ifdef MOON_ENABLE_IO_URING
+            //the kernel holds the listener while an accept request is pending on it
+            if (nullptr != iter->second->accept_op)
+            {
+                worker_->uring_->cancel(iter->second->accept_op);
+            }
+#endif
             iter->second->acceptor.cancel();
             iter->second->acceptor.close();
         }
+        bool sharded = iter->second->sharded;
+        own(iter->second, false);
         acceptors_.erase(iter);
+
+        if (sharded)
+        {
+            //the fd is owned by the worker that called listen_sharded
+            if ((fd >> 16) != worker_->id())
+            {
+                return true;
+            }
+
+            for (auto& w : router_->get_server()->get_workers())
+            {
+                if (w.get() != worker_)
+                {
+                    asio::post(w->io_context(), [w = w.get(), fd] {
+                        w->socket().close(fd);
+                    });
+                }
+            }
+        }
         unlock_fd(fd);
         return true;
     }
@@ -303,6 +511,69 @@ bool socket::set_enable_chunked(uint32_t fd, std::string_view flag)
     return false;
 }
 
+bool socket::set_framing(uint32_t fd, std::string_view mode)
+{
+    frame_header v = frame_header::u16;
+    if (mode == "u16")
+    {
+        v = frame_header::u16;
+    }
+    else if (mode == "u32")
+    {
+        v = frame_header::u32;
+    }
+    else if (mode == "varint")
+    {
+        v = frame_header::varint;
+    }
+    else
+    {
+        CONSOLE_WARN(router_->logger(),
+            "tcp::set_framing Unsupported framing %s.Support: 'u16' 'u32' 'varint'.", std::string{ mode }.data());
+        return false;
+    }
+
+    if (auto iter = connections_.find(fd); iter != connections_.end())
+    {
+        auto c = std::dynamic_pointer_cast<moon_connection>(iter->second);
+        if (c)
+        {
+            c->set_frame_header(v);
+            return true;
+        }
+        return false;
+    }
+
+    if (auto iter = acceptors_.find(fd); iter != acceptors_.end())
+    {
+        auto& ctx = iter->second;
+        if (ctx->type != PTYPE_SOCKET)
+        {
+            return false;
+        }
+        ctx->framing = v;
+
+        //the other listeners of listen_sharded
+        if (ctx->sharded && (fd >> 16) == worker_->id())
+        {
+            for (auto& w : router_->get_server()->get_workers())
+            {
+                if (w.get() != worker_)
+                {
+                    asio::post(w->io_context(), [w = w.get(), fd, v] {
+                        if (auto it = w->socket().acceptors_.find(fd); it != w->socket().acceptors_.end())
+                        {
+                            it->second->framing = v;
+                        }
+                    });
+                }
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
 bool moon::socket::set_send_queue_limit(uint32_t fd, uint32_t warnsize, uint32_t errorsize)
 {
     if (auto iter = connections_.find(fd); iter != connections_.end())
@@ -313,12 +584,60 @@ bool moon::socket::set_send_queue_limit(uint32_t fd, uint32_t warnsize, uint32_t
     return false;
 }
 
+uint32_t moon::socket::accept_count() const
+{
+    return accept_count_.load(std::memory_order_relaxed);
+}
+
 size_t moon::socket::socket_num()
 {
     std::unique_lock lck(lock_);
     return fd_watcher_.size();
 }
 
+bool moon::socket::read_paused(uint32_t owner) const
+{
+    return worker_->mailbox_full(owner);
+}
+
+void moon::socket::resume_read(uint32_t owner)
+{
+    for (const auto& it : connections_)
+    {
+        if (it.second->owner() == owner)
+        {
+            it.second->resume_read();
+        }
+    }
+}
+
+bool moon::socket::has_owner(uint32_t serviceid) const
+{
+    return owned_.find(serviceid) != owned_.end();
+}
+
+void moon::socket::own(uint32_t serviceid)
+{
+    ++owned_[serviceid];
+}
+
+void moon::socket::disown(uint32_t serviceid)
+{
+    if (auto iter = owned_.find(serviceid); iter != owned_.end() && --iter->second == 0)
+    {
+        owned_.erase(iter);
+    }
+}
+
+void moon::socket::own(const acceptor_context_ptr_t& ctx, bool v)
+{
+    v ? own(ctx->owner) : disown(ctx->owner);
+    for (auto owner : ctx->owners)
+    {
+        v ? own(owner) : disown(owner);
+    }
+}
+
 std::string moon::socket::getaddress(uint32_t fd)
 {
 	if (auto iter = connections_.find(fd); iter != connections_.end())
@@ -343,22 +662,32 @@ uint32_t socket::uuid()
 
 connection_ptr_t socket::make_connection(uint32_t serviceid, uint8_t type)
 {
+    //connections of a worker with a uring do their reads and writes through it
+    auto create = [this, serviceid, type](auto* tag) -> connection_ptr_t {
+        using connection_t = std::remove_pointer_t<decltype(tag)>;
+#ifdef MOON_ENABLE_IO_URING
+        return std::make_shared<connection_t>(serviceid, type, this, ioc_, worker_->uring_.get());
+#else
+        return std::make_shared<connection_t>(serviceid, type, this, ioc_);
+#endif
+    };
+
     connection_ptr_t connection;
     switch (type)
     {
     case PTYPE_SOCKET:
     {
-        connection = std::make_shared<moon_connection>(serviceid, type, this, ioc_);
+        connection = create(static_cast<moon_connection*>(nullptr));
         break;
     }
     case PTYPE_TEXT:
     {
-        connection = std::make_shared<stream_connection>(serviceid, type, this, ioc_);
+        connection = create(static_cast<stream_connection*>(nullptr));
         break;
     }
     case PTYPE_SOCKET_WS:
     {
-        connection = std::make_shared<ws_connection>(serviceid, type, this, ioc_);
+        connection = create(static_cast<ws_connection*>(nullptr));
         break;
     }
     default:
@@ -401,6 +730,7 @@ void socket::add_connection(socket* from, const acceptor_context_ptr_t& ctx, con
 {
     asio::dispatch(ioc_, [this, from, ctx, c, sessionid] {
         connections_.emplace(c->fd(), c);
+        own(c->owner());
         c->start(true);
 
         if (sessionid != 0)
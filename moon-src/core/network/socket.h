@@ -11,6 +11,7 @@ namespace moon
     class worker;
     class service;
     class base_connection;
+    class uring_op;
 
     using connection_ptr_t = std::shared_ptr<base_connection>;
 
@@ -30,6 +31,19 @@ namespace moon
             uint32_t owner;
             uint32_t fd = 0;
             asio::ip::tcp::acceptor acceptor;
+            //listen_sharded: the services that take its connections, they are kept on their workers while it is open
+            std::vector<uint32_t> owners;
+            //owners this listener hands connections to in turn, with the worker each one runs on
+            std::vector<std::pair<uint32_t, worker*>> targets;
+            size_t next_target = 0;
+            //one of the listeners of listen_sharded, all of them are closed with the first worker's
+            bool sharded = false;
+            //length header of the PTYPE_SOCKET connections it accepts
+            frame_header framing = frame_header::u16;
+#ifdef MOON_ENABLE_IO_URING
+            //accept request in flight on the worker's uring
+            uring_op* accept_op = nullptr;
+#endif
         };
 
         using acceptor_context_ptr_t = std::shared_ptr<acceptor_context>;
@@ -48,6 +62,10 @@ namespace moon
 
         uint32_t listen(const std::string& host, uint16_t port, uint32_t owner, uint8_t type);
 
+        //one SO_REUSEPORT listener on each worker, so the kernel spreads accepts over the workers.
+        //connections go to owners in turn, to those on the accepting worker if it has any
+        uint32_t listen_sharded(const std::string& host, uint16_t port, uint32_t owner, uint8_t type, std::vector<uint32_t> owners);
+
         void accept(uint32_t fd, int32_t sessionid, uint32_t owner);
 
         int connect(const std::string& host, uint16_t port, uint32_t owner, uint8_t type, int32_t sessionid, int32_t timeout = 0);
@@ -58,6 +76,9 @@ namespace moon
 
         bool write_message(uint32_t fd, void* msg);
 
+        //websocket frame encoded once, shared by all connections it is written to
+        static buffer_ptr_t make_ws_frame(buffer_ptr_t data, buffer_flag flag);
+
         bool close(uint32_t fd);
 
         bool settimeout(uint32_t fd, int v);
@@ -66,10 +87,24 @@ namespace moon
 
         bool set_enable_chunked(uint32_t fd, std::string_view flag);
 
+        //"u16" "u32" or "varint", for a PTYPE_SOCKET connection or the connections a listener accepts from now on
+        bool set_framing(uint32_t fd, std::string_view mode);
+
         bool set_send_queue_limit(uint32_t fd, uint32_t warnsize, uint32_t errorsize);
 
         size_t socket_num();
 
+        //connections accepted by the listeners of this worker
+        uint32_t accept_count() const;
+
+        //the service owns a connection or a listener of this worker
+        bool has_owner(uint32_t serviceid) const;
+
+        //backpressure: the owner's mailbox is full, its connections stop reading
+        bool read_paused(uint32_t owner) const;
+
+        void resume_read(uint32_t owner);
+
 		std::string getaddress(uint32_t fd);
     private:
         uint32_t uuid();
@@ -84,6 +119,21 @@ namespace moon
 
         void add_connection(socket* from, const acceptor_context_ptr_t& ctx, const connection_ptr_t & c, int32_t  sessionid);
 
+        //the connection is made on w, the worker its owner runs on
+        void accept(uint32_t fd, int32_t sessionid, uint32_t owner, worker* w);
+
+        void start_shard(const acceptor_context_ptr_t& ctx);
+
+        //count a socket to its owner, or take it away
+        void own(uint32_t serviceid);
+
+        void disown(uint32_t serviceid);
+
+        //the owner of a listener and the owners of a sharded one
+        void own(const acceptor_context_ptr_t& ctx, bool v);
+
+        void accept_next(const acceptor_context_ptr_t& ctx);
+
         template<typename Message>
         void handle_message(uint32_t serviceid, Message&& m);
 
@@ -92,6 +142,7 @@ namespace moon
         void timeout();
     private:
         std::atomic<uint32_t> uuid_ = 0;
+        std::atomic<uint32_t> accept_count_ = 0;
         router* router_;
         worker* worker_;
         asio::io_context& ioc_;
@@ -100,6 +151,8 @@ namespace moon
         mutable rwlock lock_;
         std::unordered_map<uint32_t, acceptor_context_ptr_t> acceptors_;
         std::unordered_map<uint32_t, connection_ptr_t> connections_;
+        //serviceid -> number of its sockets in acceptors_ and connections_
+        std::unordered_map<uint32_t, uint32_t> owned_;
         std::unordered_set<uint32_t> fd_watcher_;
     };
 
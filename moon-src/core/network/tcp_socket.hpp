@@ -0,0 +1,191 @@
+#pragma once
+#include "config.hpp"
+#include "asio.hpp"
+#include "uring.h"
+
+namespace moon
+{
+#ifdef MOON_ENABLE_IO_URING
+    /*
+        asio tcp socket whose reads and writes go through the worker's io_uring when it
+        has one. Connect, accept, options and close stay on the asio socket, reached
+        through lowest_layer(). Without a uring it is the plain asio socket.
+    */
+    class tcp_socket
+    {
+    public:
+        using lowest_layer_type = asio::ip::tcp::socket;
+
+        using executor_type = lowest_layer_type::executor_type;
+
+        tcp_socket(asio::io_context& ioc, uring* u)
+            : socket_(ioc)
+            , uring_(u)
+        {
+        }
+
+        tcp_socket(const tcp_socket&) = delete;
+
+        tcp_socket& operator=(const tcp_socket&) = delete;
+
+        executor_type get_executor()
+        {
+            return socket_.get_executor();
+        }
+
+        lowest_layer_type& lowest_layer()
+        {
+            return socket_;
+        }
+
+        bool is_open() const
+        {
+            return socket_.is_open();
+        }
+
+        template<typename SettableSocketOption>
+        void set_option(const SettableSocketOption& option, asio::error_code& ec)
+        {
+            socket_.set_option(option, ec);
+        }
+
+        asio::ip::tcp::endpoint remote_endpoint(asio::error_code& ec) const
+        {
+            return socket_.remote_endpoint(ec);
+        }
+
+        void shutdown(asio::socket_base::shutdown_type what, asio::error_code& ec)
+        {
+            socket_.shutdown(what, ec);
+        }
+
+        void close(asio::error_code& ec)
+        {
+            //the kernel keeps the file while a request holds it, closing the fd is not enough
+            if (nullptr != read_op_)
+            {
+                uring_->cancel(read_op_);
+            }
+
+            if (nullptr != write_op_)
+            {
+                uring_->cancel(write_op_);
+            }
+            socket_.close(ec);
+        }
+
+        template<typename MutableBufferSequence, typename ReadHandler>
+        auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+        {
+            if (nullptr == uring_)
+            {
+                return socket_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+            }
+
+            return asio::async_initiate<ReadHandler, void(asio::error_code, std::size_t)>(
+                [this](auto&& h, const MutableBufferSequence& b) {
+                    start(std::move(h), b, true);
+                }, handler, buffers);
+        }
+
+        template<typename ConstBufferSequence, typename WriteHandler>
+        auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+        {
+            if (nullptr == uring_)
+            {
+                return socket_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+            }
+
+            return asio::async_initiate<WriteHandler, void(asio::error_code, std::size_t)>(
+                [this](auto&& h, const ConstBufferSequence& b) {
+                    start(std::move(h), b, false);
+                }, handler, buffers);
+        }
+    private:
+        template<typename Handler, typename BufferSequence>
+        void start(Handler&& handler, const BufferSequence& buffers, bool read)
+        {
+            size_t count = 0;
+            auto end = asio::buffer_sequence_end(buffers);
+            for (auto it = asio::buffer_sequence_begin(buffers); it != end && count < uring_iov_data::max_iov; ++it)
+            {
+                if (asio::buffer_size(*it) != 0)
+                {
+                    ++count;
+                }
+            }
+
+            //nothing to transfer completes at once, as with asio
+            if (0 == count)
+            {
+                asio::post(socket_.get_executor(), [h = std::move(handler)]() mutable {
+                    h(asio::error_code(), 0);
+                });
+                return;
+            }
+
+            auto complete = [this, read, h = std::move(handler)](int res) mutable {
+                (read ? read_op_ : write_op_) = nullptr;
+                asio::error_code ec = uring::make_error(res);
+                if (read && 0 == res)
+                {
+                    ec = asio::error::eof;
+                }
+                h(ec, (res > 0) ? static_cast<size_t>(res) : 0);
+            };
+
+            uring_op*& slot = read ? read_op_ : write_op_;
+            int flags = read ? 0 : MSG_NOSIGNAL;
+            if (1 == count)
+            {
+                auto it = asio::buffer_sequence_begin(buffers);
+                while (asio::buffer_size(*it) == 0)
+                {
+                    ++it;
+                }
+
+                auto op = uring_->make_op(std::move(complete));
+                io_uring_sqe* sqe = uring_->prepare(op);
+                sqe->opcode = read ? IORING_OP_RECV : IORING_OP_SEND;
+                sqe->fd = socket_.native_handle();
+                sqe->addr = reinterpret_cast<uint64_t>((*it).data());
+                sqe->len = static_cast<uint32_t>((*it).size());
+                sqe->msg_flags = flags;
+                slot = op;
+                return;
+            }
+
+            auto op = uring_->make_op<uring_iov_data>(std::move(complete));
+            auto& data = op->data;
+            count = 0;
+            for (auto it = asio::buffer_sequence_begin(buffers); it != end && count < uring_iov_data::max_iov; ++it)
+            {
+                if (asio::buffer_size(*it) != 0)
+                {
+                    data.iov[count].iov_base = const_cast<void*>(static_cast<const void*>((*it).data()));
+                    data.iov[count].iov_len = (*it).size();
+                    ++count;
+                }
+            }
+            data.msg.msg_iov = data.iov;
+            data.msg.msg_iovlen = count;
+
+            io_uring_sqe* sqe = uring_->prepare(op);
+            sqe->opcode = read ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+            sqe->fd = socket_.native_handle();
+            sqe->addr = reinterpret_cast<uint64_t>(&data.msg);
+            sqe->len = 1;
+            sqe->msg_flags = flags;
+            slot = op;
+        }
+    private:
+        lowest_layer_type socket_;
+        uring* uring_;
+        //requests in flight, to cancel on close
+        uring_op* read_op_ = nullptr;
+        uring_op* write_op_ = nullptr;
+    };
+#else
+    using tcp_socket = asio::ip::tcp::socket;
+#endif
+}
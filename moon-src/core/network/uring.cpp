@@ -0,0 +1,296 @@
+#ifdef MOON_ENABLE_IO_URING
+#include "uring.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace moon;
+
+uring::uring(asio::io_context& ioc)
+    : ioc_(ioc)
+    , ring_(ioc)
+{
+}
+
+uring::~uring()
+{
+    if (ring_.is_open())
+    {
+        asio::error_code ignore;
+        ring_.close(ignore);
+        fd_ = -1;
+    }
+
+    if (nullptr != sqes_)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+
+    if (nullptr != cq_map_ && cq_map_ != sq_map_)
+    {
+        munmap(cq_map_, cq_map_size_);
+    }
+
+    if (nullptr != sq_map_)
+    {
+        munmap(sq_map_, sq_map_size_);
+    }
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+int uring::open(unsigned entries)
+{
+    io_uring_params p{};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd_ < 0)
+    {
+        return errno;
+    }
+
+    //sockets are waited on by the kernel's internal poll instead of a worker thread
+    if (!(p.features & IORING_FEAT_FAST_POLL) || !(p.features & IORING_FEAT_NODROP))
+    {
+        return EOPNOTSUPP;
+    }
+
+    sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+    {
+        sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+    }
+
+    sq_map_ = mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED)
+    {
+        sq_map_ = nullptr;
+        return errno;
+    }
+
+    if (single)
+    {
+        cq_map_ = sq_map_;
+    }
+    else
+    {
+        cq_map_ = mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_map_ == MAP_FAILED)
+        {
+            cq_map_ = nullptr;
+            return errno;
+        }
+    }
+
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        return errno;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto sq = static_cast<char*>(sq_map_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_flags_ = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_entries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+
+    auto cq = static_cast<char*>(cq_map_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+
+    asio::error_code ec;
+    ring_.assign(fd_, ec);
+    if (ec)
+    {
+        return ec.value();
+    }
+    wait_completion();
+    return 0;
+}
+
+io_uring_sqe* uring::prepare(uring_op* op)
+{
+    io_uring_sqe* sqe = next_sqe();
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+
+    op->prev_ = nullptr;
+    op->next_ = live_;
+    if (nullptr != live_)
+    {
+        live_->prev_ = op;
+    }
+    live_ = op;
+    ++live_count_;
+    submit_count_.fetch_add(1, std::memory_order_relaxed);
+    return sqe;
+}
+
+void uring::cancel(uring_op* op)
+{
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(op);
+    sqe->user_data = 0;
+}
+
+void uring::shutdown()
+{
+    for (uring_op* op = live_; nullptr != op; op = op->next_)
+    {
+        cancel(op);
+    }
+
+    //completions now destroy their handlers instead of calling them
+    stopping_ = true;
+    while (live_count_ > 0)
+    {
+        if (enter(sq_queued_, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            break;
+        }
+        sq_queued_ = 0;
+        reap();
+    }
+
+    asio::error_code ignore;
+    ring_.cancel(ignore);
+}
+
+io_uring_sqe* uring::next_sqe()
+{
+    if (*sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+    {
+        //submission ring full, hand it to the kernel now
+        flush();
+        if (*sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+        {
+            //the kernel refused while its completion backlog is full, rare: make room inline
+            while (reap())
+            {
+            }
+            flush();
+        }
+    }
+
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++sq_queued_;
+
+    if (!flush_scheduled_)
+    {
+        flush_scheduled_ = true;
+        asio::post(ioc_, [this] {
+            flush();
+        });
+    }
+    return sqe;
+}
+
+int uring::enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    enter_count_.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0));
+}
+
+void uring::flush()
+{
+    flush_scheduled_ = false;
+    while (sq_queued_ > 0)
+    {
+        int n = enter(sq_queued_, 0, 0);
+        if (n >= 0)
+        {
+            sq_queued_ -= std::min(sq_queued_, static_cast<unsigned>(n));
+            continue;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        //completion backlog full, retried on the next flush once completions are reaped
+        break;
+    }
+}
+
+void uring::wait_completion()
+{
+    ring_.async_wait(asio::posix::stream_descriptor::wait_read, [this](const asio::error_code& e) {
+        if (e)
+        {
+            return;
+        }
+
+        while (reap())
+        {
+        }
+        //requests made by the handlers go in with one io_uring_enter
+        flush();
+        wait_completion();
+    });
+}
+
+bool uring::reap()
+{
+    bool handled = false;
+    unsigned head = 0;
+    //a handler may reap too, head is read again after each one
+    while ((head = *cq_head_) != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+    {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        auto op = reinterpret_cast<uring_op*>(cqe.user_data);
+        int res = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        handled = true;
+
+        //result of a cancel request
+        if (nullptr == op)
+        {
+            continue;
+        }
+
+        if (nullptr != op->prev_)
+        {
+            op->prev_->next_ = op->next_;
+        }
+        else
+        {
+            live_ = op->next_;
+        }
+
+        if (nullptr != op->next_)
+        {
+            op->next_->prev_ = op->prev_;
+        }
+        --live_count_;
+
+        op->complete_(op, res, stopping_);
+    }
+
+    //cqes the kernel kept aside while the ring was full
+    if (!handled && (__atomic_load_n(sq_flags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+    {
+        enter(0, 0, IORING_ENTER_GETEVENTS);
+        return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+    }
+    return handled;
+}
+#endif
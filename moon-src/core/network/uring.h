@@ -0,0 +1,176 @@
+#pragma once
+#ifdef MOON_ENABLE_IO_URING
+#include "config.hpp"
+#include "asio.hpp"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace moon
+{
+    //one request in flight on a uring, completed with the cqe result
+    class uring_op
+    {
+        friend class uring;
+    public:
+        using complete_fn = void(*)(uring_op*, int res, bool destroy);
+
+        explicit uring_op(complete_fn fn)
+            :complete_(fn)
+        {
+        }
+
+        uring_op(const uring_op&) = delete;
+
+        uring_op& operator=(const uring_op&) = delete;
+    protected:
+        ~uring_op() = default;
+    private:
+        complete_fn complete_;
+        uring_op* prev_ = nullptr;
+        uring_op* next_ = nullptr;
+    };
+
+    struct uring_no_data
+    {
+    };
+
+    //scatter/gather list of a recvmsg or sendmsg
+    struct uring_iov_data
+    {
+        static constexpr size_t max_iov = 64;
+
+        iovec iov[max_iov];
+        msghdr msg{};
+    };
+
+    struct uring_timeout_data
+    {
+        __kernel_timespec ts{};
+    };
+
+    template<typename Handler, typename Data = uring_no_data>
+    class uring_handler_op final : public uring_op
+    {
+    public:
+        explicit uring_handler_op(Handler&& h)
+            :uring_op(&do_complete)
+            , handler_(std::move(h))
+        {
+        }
+
+        //memory the kernel reads while the request is in flight
+        Data data;
+    private:
+        static void do_complete(uring_op* base, int res, bool destroy)
+        {
+            auto op = static_cast<uring_handler_op*>(base);
+            Handler handler(std::move(op->handler_));
+            delete op;
+            if (!destroy)
+            {
+                handler(res);
+            }
+        }
+
+        Handler handler_;
+    };
+
+    /*
+        A worker's io_uring. Requests are queued in the submission ring and submitted
+        together, one io_uring_enter per turn of the worker's io_context. Completions are
+        reaped when the ring fd becomes readable in the io_context's reactor, and handlers
+        run on the worker thread.
+    */
+    class uring
+    {
+    public:
+        static constexpr unsigned ENTRIES = 4096;
+
+        explicit uring(asio::io_context& ioc);
+
+        ~uring();
+
+        uring(const uring&) = delete;
+
+        uring& operator=(const uring&) = delete;
+
+        //0, or the errno of io_uring_setup when the kernel refuses
+        int open(unsigned entries);
+
+        //handler(int res) is called with the cqe result, or destroyed without a call on shutdown
+        template<typename Data = uring_no_data, typename Handler>
+        uring_handler_op<std::decay_t<Handler>, Data>* make_op(Handler&& h)
+        {
+            return new uring_handler_op<std::decay_t<Handler>, Data>(std::forward<Handler>(h));
+        }
+
+        //a zeroed sqe carrying op, submitted on this turn's flush
+        io_uring_sqe* prepare(uring_op* op);
+
+        //ask the kernel to cancel op, it completes with -ECANCELED unless already done
+        void cancel(uring_op* op);
+
+        //cancel everything in flight and wait until it completed, worker thread only
+        void shutdown();
+
+        uint64_t enter_count() const
+        {
+            return enter_count_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t submit_count() const
+        {
+            return submit_count_.load(std::memory_order_relaxed);
+        }
+
+        static asio::error_code make_error(int res)
+        {
+            return (res < 0) ? asio::error_code(-res, asio::error::get_system_category()) : asio::error_code();
+        }
+    private:
+        io_uring_sqe* next_sqe();
+
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+        void flush();
+
+        void wait_completion();
+
+        //true if any cqe was handled
+        bool reap();
+    private:
+        int fd_ = -1;
+        bool flush_scheduled_ = false;
+        bool stopping_ = false;
+        unsigned sq_queued_ = 0;
+        asio::io_context& ioc_;
+        asio::posix::stream_descriptor ring_;
+        std::atomic<uint64_t> enter_count_ = 0;
+        std::atomic<uint64_t> submit_count_ = 0;
+
+        void* sq_map_ = nullptr;
+        size_t sq_map_size_ = 0;
+        void* cq_map_ = nullptr;
+        size_t cq_map_size_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqes_size_ = 0;
+
+        unsigned* sq_head_ = nullptr;
+        unsigned* sq_tail_ = nullptr;
+        unsigned* sq_flags_ = nullptr;
+        unsigned* sq_array_ = nullptr;
+        unsigned sq_mask_ = 0;
+        unsigned sq_entries_ = 0;
+
+        unsigned* cq_head_ = nullptr;
+        unsigned* cq_tail_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+        unsigned cq_mask_ = 0;
+
+        //requests in flight, to destroy their handlers on shutdown
+        uring_op* live_ = nullptr;
+        size_t live_count_ = 0;
+    };
+}
+#endif
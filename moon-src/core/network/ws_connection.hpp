@@ -5,6 +5,7 @@
 #include "common/byte_convert.hpp"
 #include "common/sha1.hpp"
 #include "common/random.hpp"
+#include "common/ws_mask.hpp"
 
 //https://developer.mozilla.org/en-US/docs/Web/API/WebSockets_API/Writing_WebSocket_servers
 
@@ -116,7 +117,9 @@ namespace moon
 
         static constexpr size_t HANDSHAKE_STREAMBUF_SIZE = 8192;
 
-        static constexpr size_t DEFAULT_RECV_BUFFER_SIZE = 128;
+        static constexpr size_t RECV_BUFFER_SIZE = 8192;
+        //a frame this large that ends the receive buffer is handed over with it instead of copied
+        static constexpr size_t HANDOFF_SIZE = RECV_BUFFER_SIZE / 2;
 
         static constexpr size_t SEC_WEBSOCKET_KEY_LEN = 24;
 
@@ -152,23 +155,43 @@ namespace moon
         bool send(buffer_ptr_t data) override
         {
             if (!handshaked_) return false;
-            encode_frame(data);
+            if (data->has_flag(buffer_flag::ws_frame))
+            {
+                //pre-encoded frames are unmasked, only a server may send them
+                if (role_ == role::client)
+                {
+                    return false;
+                }
+            }
+            else if (role_ == role::client)
+            {
+                //masking rewrites the payload, never do it on a buffer someone else holds
+                bool shared = data.use_count() > 1;
+                data = encode_frame(std::move(data), true, shared);
+            }
+            else
+            {
+                //a broadcast buffer may be written by other workers at the same time
+                bool shared = data->has_flag(buffer_flag::broadcast);
+                data = encode_frame(std::move(data), false, shared);
+                //writing the same buffer to other connections reuses the frame
+                data->set_flag(buffer_flag::ws_frame);
+            }
             return base_connection_t::send(std::move(data));
         }
 
-    protected:
-        void check_recv_buffer(size_t size)
+        //encode a server frame once, the result can be sent to any number of connections without copy
+        static buffer_ptr_t make_frame(buffer_ptr_t data)
         {
-            if (nullptr == recv_buf_)
+            if (!data->has_flag(buffer_flag::ws_frame))
             {
-                recv_buf_ = message::create_buffer(size);
-            }
-            else
-            {
-                recv_buf_->prepare(size);
+                data = encode_frame(std::move(data), false, false);
+                data->set_flag(buffer_flag::ws_frame);
             }
+            return data;
         }
 
+    protected:
         void read_header()
         {
             auto sbuf = std::make_shared<asio::streambuf>(HANDSHAKE_STREAMBUF_SIZE);
@@ -193,10 +216,10 @@ namespace moon
                 auto ec = handshake(sbuf);
                 if (!ec)
                 {
-                    check_recv_buffer(DEFAULT_RECV_BUFFER_SIZE);
                     if (num_additional_bytes > 0)
                     {
                         auto data = reinterpret_cast<const char*>(sbuf->data().data());
+                        recv_buf_ = message::create_buffer(RECV_BUFFER_SIZE);
                         recv_buf_->write_back(data, num_additional_bytes);
                         if (!handle_frame())
                         {
@@ -299,7 +322,18 @@ namespace moon
                         msg->write_data(address());
                         msg->set_receiver(static_cast<uint8_t>(socket_data_type::socket_connect));
                         handle_message(std::move(msg));
-                        check_recv_buffer(DEFAULT_RECV_BUFFER_SIZE);
+                        //frames the server sent right after the handshake response
+                        size_t num_additional_bytes = sbuf->size() - bytes_transferred;
+                        if (num_additional_bytes > 0)
+                        {
+                            auto data = reinterpret_cast<const char*>(sbuf->data().data()) + bytes_transferred;
+                            recv_buf_ = message::create_buffer(RECV_BUFFER_SIZE);
+                            recv_buf_->write_back(data, num_additional_bytes);
+                            if (!handle_frame())
+                            {
+                                return;
+                            }
+                        }
                         read_some();
                     });
                 }
@@ -310,9 +344,32 @@ namespace moon
             });
         }
 
+        void on_resume_read() override
+        {
+            //frames left in the receive buffer when the owner's mailbox filled up go first
+            if (handle_frame())
+            {
+                read_some();
+            }
+        }
+
+        //read what the socket has, up to the free space of the receive buffer, and parse every frame in it
         void read_some()
         {
-            socket_.async_read_some(asio::buffer(recv_buf_->data() + recv_buf_->size(), recv_buf_->writeablesize()),
+            if (read_paused())
+            {
+                return;
+            }
+
+            if (nullptr == recv_buf_)
+            {
+                recv_buf_ = message::create_buffer(RECV_BUFFER_SIZE);
+            }
+            recv_buf_->prepare(std::max(need_, RECV_BUFFER_SIZE / 2));
+
+            //the rest of a large frame alone, so that the buffer can be handed over with it
+            size_t n = (need_ >= HANDOFF_SIZE) ? need_ : recv_buf_->writeablesize();
+            socket_.async_read_some(asio::buffer(recv_buf_->data() + recv_buf_->size(), n),
                     [this, self = shared_from_this()](const asio::error_code& e, std::size_t bytes_transferred)
             {
                 if (e)
@@ -328,8 +385,7 @@ namespace moon
                 }
 
                 recvtime_ = now();
-                recv_buf_->commit(static_cast<int>(bytes_transferred));
- 
+                recv_buf_->commit(bytes_transferred);
                 if (!handle_frame())
                 {
                     return;
@@ -417,45 +473,62 @@ namespace moon
             base_connection::send(buf);
         }
 
+        //false when the connection got an error or was closed by its owner.
+        //stops with frames left when the owner's mailbox is full, on_resume_read handles them
         bool handle_frame()
         {
-            auto ec = decode_frame();
-            if (ec)
+            need_ = 0;
+            //recv_buf_ is null once a frame took it
+            while (nullptr != recv_buf_ && recv_buf_->size() != 0)
             {
-                if (ec == moon::error::ws_closed && recv_buf_->size()>1)
+                if (read_paused())
                 {
-                    uint16_t code = *(const uint16_t*)recv_buf_->data();
-                    std::string reason;
-                    reason.append(std::to_string(code));
-                    recv_buf_->seek(2);
-                    if (recv_buf_->size() != 0)
+                    break;
+                }
+                auto ec = decode_frame();
+                if (ec)
+                {
+                    if (ec == moon::error::ws_closed && recv_buf_->size()>1)
                     {
-                        reason.append(":");
-                        reason.append(recv_buf_->data(), recv_buf_->size());
+                        uint16_t code = *(const uint16_t*)recv_buf_->data();
+                        std::string reason;
+                        reason.append(std::to_string(code));
+                        recv_buf_->seek(2);
+                        if (recv_buf_->size() != 0)
+                        {
+                            reason.append(":");
+                            reason.append(recv_buf_->data(), recv_buf_->size());
+                        }
+                        error(ec, reason);
+                    }
+                    else
+                    {
+                        error(ec);
                     }
-                    error(ec, reason);
+                    return false;
                 }
-                else
+
+                if (need_ != 0 || !socket_.is_open())
                 {
-                    error(ec);
+                    break;
                 }
-                return false;
             }
-            return true;
+            return socket_.is_open();
         }
 
+        //decode the frame at the front of recv_buf_, sets need_ if it is incomplete
         std::error_code decode_frame()
         {
             const uint8_t* tmp = (const uint8_t*)(recv_buf_->data());
             size_t size = recv_buf_->size();
 
-            if (size < 3)
+            size_t need = 2;
+            if (size < need)
             {
-                check_recv_buffer(10);
+                need_ = need - size;
                 return std::error_code();
             }
 
-            size_t need = 2;
             ws::frame_header fh;
 
             fh.payload_len = tmp[1] & 0x7F;
@@ -482,7 +555,7 @@ namespace moon
             //need more data
             if (size < need)
             {
-                check_recv_buffer(need);
+                need_ = need - size;
                 return std::error_code();
             }
 
@@ -532,7 +605,8 @@ namespace moon
             {
             case PAYLOAD_MID_LEN:
             {
-                auto n = *(uint16_t*)(&tmp[2]);
+                uint16_t n = 0;
+                std::memcpy(&n, &tmp[2], sizeof(n));
                 moon::net2host(n);
                 reallen = n;
                 if (reallen < PAYLOAD_MID_LEN)
@@ -551,7 +625,7 @@ namespace moon
                 }
                 else
                 {
-                    reallen = *(uint64_t*)(&tmp[2]);
+                    std::memcpy(&reallen, &tmp[2], sizeof(reallen));
                     moon::net2host(reallen);
                     if (reallen < 65536)
                     {
@@ -569,39 +643,38 @@ namespace moon
             if (size < need + reallen)
             {
                 //need more data
-                check_recv_buffer(static_cast<size_t>(need + reallen - size));
+                need_ = static_cast<size_t>(need + reallen - size);
                 return std::error_code();
             }
 
             if (fh.mask)
             {
-                fh.key = *((uint32_t*)(tmp + (need - sizeof(fh.key))));
+                std::memcpy(&fh.key, tmp + (need - sizeof(fh.key)), sizeof(fh.key));
                 // unmask data:
-                uint8_t* d = (uint8_t*)(tmp + need);
-                for (uint64_t i = 0; i < reallen; i++)
-                {
-                    d[i] = d[i] ^ ((uint8_t*)(&fh.key))[i % 4];
-                }
+                ws_mask((uint8_t*)(tmp + need), static_cast<size_t>(reallen), (const uint8_t*)(&fh.key));
             }
 
+            recv_buf_->consume(need);
             if (fh.op == ws::opcode::close)
             {
-                recv_buf_->seek(static_cast<int>(need), buffer::seek_origin::Current);
+                //only the close payload is left for the reason, the connection is closed
+                recv_buf_->revert(recv_buf_->size() - static_cast<size_t>(reallen));
                 return make_error_code(moon::error::ws_closed);
             }
 
-            recv_buf_->seek(static_cast<int>(need), buffer::seek_origin::Current);
-            message_ptr_t msg = nullptr;
-            if (recv_buf_->size()==reallen)
+            buffer_ptr_t data;
+            if (recv_buf_->size() == reallen && reallen >= HANDOFF_SIZE)
             {
-                msg = message::create(std::move(recv_buf_));
+                //last frame in the receive buffer, the message takes the buffer instead of a copy
+                data = std::move(recv_buf_);
             }
             else
             {
-                msg = message::create(reallen);
-                msg->get_buffer()->write_back(recv_buf_->data(), reallen);
-                recv_buf_->seek(static_cast<int>(reallen));
+                data = message::create_buffer(static_cast<size_t>(reallen));
+                data->write_back(recv_buf_->data(), static_cast<size_t>(reallen));
+                recv_buf_->consume(static_cast<size_t>(reallen));
             }
+            auto msg = message::create(std::move(data));
 
             switch (fh.op)
             {
@@ -621,69 +694,85 @@ namespace moon
             }
 
             handle_message(std::move(msg));
-
-            check_recv_buffer(DEFAULT_RECV_BUFFER_SIZE);
-            return decode_frame();
+            return std::error_code();
         }
 
-        void encode_frame(const buffer_ptr_t& data)
+        //header + payload of a frame, payload is masked while it is copied
+        static buffer_ptr_t encode_frame(buffer_ptr_t data, bool mask, bool copy)
         {
             uint64_t size = data->size();
 
-            if (role_ == role::client)
+            //opcode(1) + payload_len(1) + extended payload length(8) + masking key(4)
+            uint8_t header[14];
+            size_t n = 0;
+
+            uint8_t opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::binary);
+            if (data->has_flag(buffer_flag::ws_text))
             {
-                auto d = reinterpret_cast<unsigned char*>(data->data());
-                const uint8_t* mask = randkey(4);
-                for (uint64_t i = 0; i < size; i++)
-                {
-                    d[i] = d[i] ^ mask[i % 4];
-                }
-                data->write_front(mask, 4);
+                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::text);
+            }
+            else if (data->has_flag(buffer_flag::ws_ping))
+            {
+                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::ping);
             }
+            else if (data->has_flag(buffer_flag::ws_pong))
+            {
+                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::pong);
+            }
+            header[n++] = opcode;
 
-            uint8_t payload_len = 0;
+            //messages from the client must be masked
+            uint8_t mask_bit = mask ? 0x80 : 0;
             if (size <= PAYLOAD_MIN_LEN)
             {
-                payload_len = static_cast<uint8_t>(size);
+                header[n++] = static_cast<uint8_t>(size) | mask_bit;
             }
             else if (size <= UINT16_MAX)
             {
-                payload_len = static_cast<uint8_t>(PAYLOAD_MID_LEN);
-                uint16_t n = (uint16_t)size;
-                moon::host2net(n);
-                data->write_front(&n, 1);
+                header[n++] = static_cast<uint8_t>(PAYLOAD_MID_LEN) | mask_bit;
+                uint16_t len = (uint16_t)size;
+                moon::host2net(len);
+                std::memcpy(header + n, &len, sizeof(len));
+                n += sizeof(len);
             }
             else
             {
-                payload_len = static_cast<uint8_t>(PAYLOAD_MAX_LEN);
-                moon::host2net(size);
-                data->write_front(&size, 1);
+                header[n++] = static_cast<uint8_t>(PAYLOAD_MAX_LEN) | mask_bit;
+                uint64_t len = size;
+                moon::host2net(len);
+                std::memcpy(header + n, &len, sizeof(len));
+                n += sizeof(len);
             }
 
-            //messages from the client must be masked
-            if (role_ == role::client)
+            const uint8_t* key = nullptr;
+            if (mask)
             {
-                payload_len |= 0x80;
+                key = randkey(4);
+                std::memcpy(header + n, key, 4);
+                n += 4;
             }
 
-            data->write_front(&payload_len, 1);
-
-            uint8_t opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::binary);
-
-            if (data->has_flag(buffer_flag::ws_text))
+            if (!copy && data->write_front(header, n))
             {
-                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::text);
+                if (nullptr != key)
+                {
+                    ws_mask(reinterpret_cast<uint8_t*>(data->data()) + n, static_cast<size_t>(size), key);
+                }
+                return data;
             }
-            else if (data->has_flag(buffer_flag::ws_ping))
+
+            auto frame = message::create_buffer(n + size, 0);
+            frame->write_back(header, n);
+            frame->write_back(data->data(), size);
+            if (nullptr != key)
             {
-                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::ping);
+                ws_mask(reinterpret_cast<uint8_t*>(frame->data()) + n, static_cast<size_t>(size), key);
             }
-            else if (data->has_flag(buffer_flag::ws_pong))
+            if (data->has_flag(buffer_flag::close))
             {
-                opcode = FIN_FRAME_FLAG | static_cast<uint8_t>(ws::opcode::pong);
+                frame->set_flag(buffer_flag::close);
             }
-
-            data->write_front(&opcode, 1);
+            return frame;
         }
 
         std::string hash_key(std::string_view seckey)
@@ -722,6 +811,9 @@ namespace moon
     protected:
         bool handshaked_ = false;
         role role_ = role::none;
+        //bytes of the next frame still to come
+        size_t need_ = 0;
+        //received bytes not parsed yet
         buffer_ptr_t recv_buf_;
     };
 }
\ No newline at end of file
@@ -23,7 +23,8 @@ namespace moon
         , int32_t sessionid)
     {
         worker* w = server_->get_worker(workerid);
-        if (nullptr != w)
+        bool shared = (nullptr == w);
+        if (!shared)
         {
             w->shared(false);
         }
@@ -31,7 +32,7 @@ namespace moon
         {
             w = server_->next_worker();
         }
-        w->add_service(std::move(service_type), std::move(config), unique, creatorid, sessionid);
+        w->add_service(std::move(service_type), std::move(config), unique, shared, creatorid, sessionid);
     }
 
     void router::remove_service(uint32_t serviceid, uint32_t sender, int32_t sessionid)
@@ -49,6 +50,22 @@ namespace moon
         }
     }
 
+    void router::migrate_service(uint32_t serviceid, uint32_t workerid, uint32_t sender, int32_t sessionid)
+    {
+        //the worker in the id still routes the service's messages, it knows where the service is
+        auto creator = worker_id(serviceid);
+        worker* w = server_->get_worker(creator);
+        if (nullptr != w)
+        {
+            w->migrate_service(serviceid, workerid, sender, sessionid);
+        }
+        else
+        {
+            auto content = moon::format("worker %d not found.", creator);
+            response(sender, "router::migrate_service "sv, content, sessionid, PTYPE_ERROR);
+        }
+    }
+
     void  router::runcmd(uint32_t sender, const std::string& cmd, int32_t sessionid)
     {
         auto params = moon::split<std::string>(cmd, ".");
@@ -140,39 +157,45 @@ namespace moon
         return nullptr;
     }
 
-    std::string router::get_env(const std::string& name) const
+    std::string router::get_env(std::string_view name) const
     {
-        std::string v;
-        if (env_.try_get_value(name, v))
+        if (auto v = env_.find(name); nullptr != v)
         {
-            return v;
+            return *v;
         }
         return std::string{};
     }
 
-    void router::set_env(std::string name, std::string value)
+    const std::string* router::find_env(std::string_view name) const
     {
-        env_.set(std::move(name), std::move(value));
+        return env_.find(name);
     }
 
-    uint32_t router::get_unique_service(const std::string& name) const
+    void router::set_env(std::string_view name, std::string value)
+    {
+        env_.set(name, std::move(value));
+    }
+
+    uint32_t router::get_unique_service(std::string_view name) const
     {
         if (name.empty())
         {
             return 0;
         }
-        uint32_t id = 0;
-        unique_services_.try_get_value(name, id);
-        return id;
+        if (auto id = unique_services_.find(name); nullptr != id)
+        {
+            return *id;
+        }
+        return 0;
     }
 
-    bool router::set_unique_service(std::string name, uint32_t v)
+    bool router::set_unique_service(std::string_view name, uint32_t v)
     {
         if (name.empty())
         {
             return false;
         }
-        return unique_services_.try_set(std::move(name), v);
+        return unique_services_.try_set(name, v);
     }
 
     size_t router::unique_service_size() const
@@ -180,6 +203,11 @@ namespace moon
         return unique_services_.size();
     }
 
+    uint64_t router::registry_version() const
+    {
+        return env_.version() + unique_services_.version();
+    }
+
     log* router::logger() const
     {
         return logger_;
@@ -1,7 +1,6 @@
 #pragma once
 #include "config.hpp"
-#include "common/concurrent_map.hpp"
-#include "common/rwlock.hpp"
+#include "common/snapshot_map.hpp"
 #include "common/log.hpp"
 
 namespace asio {
@@ -35,6 +34,8 @@ namespace moon
 
         void remove_service(uint32_t serviceid, uint32_t sender, int32_t sessionid);
 
+        void migrate_service(uint32_t serviceid, uint32_t workerid, uint32_t sender, int32_t sessionid);
+
         void runcmd(uint32_t sender, const std::string& cmd, int32_t sessionid);
 
         void send_message(message_ptr_t&& msg) const;
@@ -52,16 +53,22 @@ namespace moon
 
         service_ptr_t make_service(const std::string& type);
 
-        std::string get_env(const std::string& name) const;
+        std::string get_env(std::string_view name) const;
+
+        //no copy, valid until this thread reads env again after it changed
+        const std::string* find_env(std::string_view name) const;
 
-        void set_env(std::string name, std::string value);
+        void set_env(std::string_view name, std::string value);
 
-        uint32_t get_unique_service(const std::string& name) const;
+        uint32_t get_unique_service(std::string_view name) const;
 
-        bool set_unique_service(std::string name, uint32_t v);
+        bool set_unique_service(std::string_view name, uint32_t v);
 
         size_t unique_service_size() const;
 
+        //changes whenever env or unique services change, lets callers cache lookups
+        uint64_t registry_version() const;
+
         log* logger() const;
 
         void response(uint32_t to
@@ -85,7 +92,7 @@ namespace moon
         log* logger_ = nullptr;
         server* server_ = nullptr;
         std::unordered_map<std::string, register_func > regservices_;
-        concurrent_map<std::string, std::string, rwlock> env_;
-        concurrent_map<std::string, uint32_t, rwlock> unique_services_;
+        snapshot_map<std::string> env_;
+        snapshot_map<uint32_t> unique_services_;
     };
 }
\ No newline at end of file
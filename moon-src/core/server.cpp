@@ -18,6 +18,14 @@ namespace moon
 
         CONSOLE_INFO(logger(), "INIT with %d workers.", worker_num);
 
+#ifndef MOON_ENABLE_IO_URING
+        if (io_uring_)
+        {
+            CONSOLE_WARN(logger(), "io_uring requested, but not built in (premake5 --io_uring), use epoll.");
+            io_uring_ = false;
+        }
+#endif
+
         for (int i = 0; i != worker_num; i++)
         {
             workers_.emplace_back(std::make_unique<worker>(this, &router_, i + 1));
@@ -182,6 +190,56 @@ namespace moon
     {
         return workers_;
     }
+
+    void server::set_work_stealing(bool v)
+    {
+        work_stealing_ = v;
+    }
+
+    bool server::work_stealing() const
+    {
+        return work_stealing_;
+    }
+
+    void server::set_precise_timer(bool v)
+    {
+        precise_timer_ = v;
+    }
+
+    bool server::precise_timer() const
+    {
+        return precise_timer_;
+    }
+
+    void server::set_idle_gc(int32_t budget)
+    {
+        idle_gc_ = budget;
+    }
+
+    int32_t server::idle_gc() const
+    {
+        return idle_gc_;
+    }
+
+    void server::set_mailbox_lanes(bool v)
+    {
+        mailbox_lanes_ = v;
+    }
+
+    bool server::mailbox_lanes() const
+    {
+        return mailbox_lanes_;
+    }
+
+    void server::set_io_uring(bool v)
+    {
+        io_uring_ = v;
+    }
+
+    bool server::io_uring() const
+    {
+        return io_uring_;
+    }
 }
 
 
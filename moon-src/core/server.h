@@ -41,10 +41,35 @@ namespace moon
         worker* get_worker(uint32_t workerid) const;
 
         std::vector<std::unique_ptr<worker>>& get_workers();
+
+        void set_work_stealing(bool v);
+
+        bool work_stealing() const;
+
+        void set_precise_timer(bool v);
+
+        bool precise_timer() const;
+
+        void set_idle_gc(int32_t budget);
+
+        int32_t idle_gc() const;
+
+        void set_mailbox_lanes(bool v);
+
+        bool mailbox_lanes() const;
+
+        void set_io_uring(bool v);
+
+        bool io_uring() const;
     private:
         void wait();
     private:
         volatile int signalcode_ = 0;
+        bool work_stealing_ = false;
+        bool precise_timer_ = false;
+        int32_t idle_gc_ = 0;
+        bool mailbox_lanes_ = false;
+        bool io_uring_ = false;
         std::atomic<state> state_ = state::unknown;
         std::atomic<uint32_t> next_ = 0;
         std::time_t now_ = 0;
@@ -1,6 +1,7 @@
 #pragma once
 #include "config.hpp"
 #include "common/log.hpp"
+#include "common/histogram.hpp"
 #include "router.h"
 
 namespace moon
@@ -10,6 +11,36 @@ namespace moon
     class router;
     class worker;
 
+    enum class mailbox_policy : uint8_t
+    {
+        //reject new messages, calls get a PTYPE_ERROR response
+        reject,
+        //drop the oldest pending messages
+        drop_oldest,
+        //keep messages, pause reading the service's sockets until the mailbox drains
+        backpressure
+    };
+
+    //bounded mailbox of one service, counted by senders on any thread
+    struct mailbox_limit
+    {
+        mailbox_limit(uint32_t c, mailbox_policy p)
+            :capacity(c)
+            , policy(p)
+        {
+        }
+
+        const uint32_t capacity;
+        const mailbox_policy policy;
+        std::atomic<uint32_t> pending = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<uint64_t> rejected = 0;
+        //socket reads paused, worker thread only
+        bool paused = false;
+    };
+
+    using mailbox_limit_ptr_t = std::shared_ptr<mailbox_limit>;
+
     class service
     {
     public:
@@ -65,6 +96,12 @@ namespace moon
             return unique_;
         }
 
+        //not bound to a worker, may be moved to another worker by work stealing
+        bool shared() const
+        {
+            return shared_;
+        }
+
         log* logger() const
         {
             return log_;
@@ -92,6 +129,21 @@ namespace moon
             return v;
         }
 
+        const mailbox_limit_ptr_t& mailbox() const
+        {
+            return mailbox_;
+        }
+
+        void set_mailbox_limit(uint32_t capacity, mailbox_policy policy)
+        {
+            mailbox_ = std::make_shared<mailbox_limit>(capacity, policy);
+        }
+
+        const latency_stats& latency() const
+        {
+            return latency_;
+        }
+
         template<typename Message>
         void handle_message(Message&& m)
         {
@@ -115,6 +167,40 @@ namespace moon
             }
         }
 
+        //consecutive messages for this service, dispatched with one dispatch_batch call
+        template<typename Message>
+        void handle_messages(Message* msgs, size_t count)
+        {
+            try
+            {
+                dispatch_batch(msgs, count);
+            }
+            catch (const std::exception& e)
+            {
+                CONSOLE_ERROR(logger(), "service::handle_messages exception: %s", e.what());
+            }
+
+            //redirect message
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (msgs[i] && msgs[i]->receiver() != id_)
+                {
+                    router_->send_message(std::move(msgs[i]));
+                }
+            }
+        }
+
+        //opt-in: worker groups consecutive messages for this service into one handle_messages call
+        bool batch() const
+        {
+            return batch_;
+        }
+
+        void set_batch(bool v)
+        {
+            batch_ = v;
+        }
+
         void quit()
         {
             ok_ = false;
@@ -125,12 +211,31 @@ namespace moon
 
         virtual void dispatch(message* msg) = 0;
 
+        virtual void dispatch_batch(message_ptr_t* msgs, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                dispatch(msgs[i].get());
+            }
+        }
+
+        //called on the new worker's thread after the service was moved
+        virtual void on_migrate() {}
+
+        //one garbage collection step in the worker's idle time, false if there is nothing to collect
+        virtual bool gc_step() { return false; }
+
     protected:
         void set_unique(bool v)
         {
             unique_ = v;
         }
 
+        void set_shared(bool v)
+        {
+            shared_ = v;
+        }
+
         void set_id(uint32_t v)
         {
             id_ = v;
@@ -143,12 +248,18 @@ namespace moon
     protected:
         bool ok_ = false;
         bool unique_ = false;
+        bool shared_ = false;
+        bool batch_ = false;
         uint32_t id_ = 0;
         log* log_ = nullptr;
         server* server_ = nullptr;
         router* router_ = nullptr;
         worker* worker_ = nullptr;
         int64_t cpu_cost_ = 0;//us
+        latency_stats latency_;
+        //queued on its worker for an idle gc step
+        bool gc_queued_ = false;
+        mailbox_limit_ptr_t mailbox_;
         std::string   name_;
     };
 }
@@ -6,15 +6,42 @@
 #include "common/log.hpp"
 #include "server.h"
 #include "service.hpp"
+#include <cstring>
 
 namespace moon
 {
+    static std::string histogram_json(const histogram& h)
+    {
+        return moon::format(
+            "{\"count\":%" PRIu64 ",\"mean\":%.1f,\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+            h.count(),
+            h.mean(),
+            h.percentile(50),
+            h.percentile(90),
+            h.percentile(99),
+            h.percentile(99.9),
+            h.max());
+    }
+
+    static void histogram_metrics(std::string& content, std::string_view metric, const std::string& labels, const histogram& h)
+    {
+        for (double q : {0.5, 0.9, 0.99, 0.999})
+        {
+            content.append(moon::format("%s{%s,quantile=\"%g\"} %" PRIu64 "\n", metric.data(), labels.data(), q, h.percentile(q * 100)));
+        }
+        content.append(moon::format("%s_sum{%s} %" PRIu64 "\n", metric.data(), labels.data(), h.sum()));
+        content.append(moon::format("%s_count{%s} %" PRIu64 "\n", metric.data(), labels.data(), h.count()));
+    }
+
     worker::worker(server* srv, router* r, uint32_t id)
         : workerid_(id)
         , router_(r)
         , server_(srv)
         , io_ctx_(1)
         , work_(asio::make_work_guard(io_ctx_))
+        , timer_(static_cast<uint8_t>(id))
+        , precise_timer_(io_ctx_)
+        , service_slots_(id)
     {
     }
 
@@ -26,12 +53,36 @@ namespace moon
     std::string worker::info()
     {
         auto response = moon::format(
-            R"({"cpu":%lld,"socket_num":%zu,"mqsize":%d, "timer":%zu})",
+            R"({"cpu":%lld,"socket_num":%zu,"accept":%u,"mqsize":%d, "lanes":[%d,%d,%d], "timer":%zu, "steal":%u, "stolen":%u, "migrate_in":%u, "migrate_out":%u, "mailbox_dropped":%u, "mailbox_rejected":%u, "mailbox_paused":%u, "wakeup":%u, "gc_steps":%u, "gc_time":%lld, "gc_max":%lld})",
             cpu_cost_,
             socket_->socket_num(),
+            socket_->accept_count(),
             mqsize_.load(),
-            timer_.size()
+            lane_size_[lane_response].load(),
+            lane_size_[lane_control].load(),
+            lane_size_[lane_normal].load(),
+            timer_.size(),
+            steal_count_.load(),
+            stolen_count_.load(),
+            migrate_in_.load(),
+            migrate_out_.load(),
+            mailbox_dropped_.load(),
+            mailbox_rejected_.load(),
+            mailbox_paused_.load(),
+            wakeup_count_.load(),
+            gc_steps_.exchange(0),
+            static_cast<long long>(gc_time_.exchange(0)),
+            static_cast<long long>(gc_max_.exchange(0))
         );
+#ifdef MOON_ENABLE_IO_URING
+        if (nullptr != uring_)
+        {
+            response.pop_back();
+            response.append(moon::format(R"(, "uring_enter":%llu, "uring_submit":%llu})",
+                static_cast<unsigned long long>(uring_->enter_count()),
+                static_cast<unsigned long long>(uring_->submit_count())));
+        }
+#endif
         cpu_cost_ = 0;
         return response;
     }
@@ -55,12 +106,112 @@ namespace moon
             return content;
             });
 
+        commands_.emplace("stats"sv, [this](const std::vector<std::string_view>& params) {
+            (void)params;
+            std::string content = moon::format(R"({"worker":%u,"wait":%s,"handle":%s,"gc":%s,"services":[)",
+                id(),
+                histogram_json(latency_.wait).data(),
+                histogram_json(latency_.handle).data(),
+                histogram_json(latency_.gc).data());
+            for (auto& it : services_)
+            {
+                const auto& latency = it.second->latency();
+                content.append(moon::format(
+                    R"({"name":"%s","serviceid":"%X","wait":%s,"handle":%s,"gc":%s},)",
+                    it.second->name().data(),
+                    it.second->id(),
+                    histogram_json(latency.wait).data(),
+                    histogram_json(latency.handle).data(),
+                    histogram_json(latency.gc).data()));
+            }
+            if (content.back() == ',')
+            {
+                content.pop_back();
+            }
+            content.append("]}");
+            return content;
+            });
+
+        //prometheus text exposition format, summaries of the worker and each of its services
+        commands_.emplace("metrics"sv, [this](const std::vector<std::string_view>& params) {
+            (void)params;
+            std::string content;
+            constexpr std::string_view wait_metric = "moon_message_wait_microseconds"sv;
+            constexpr std::string_view handle_metric = "moon_message_handle_microseconds"sv;
+            std::string worker_labels = moon::format(R"(worker="%u")", id());
+            content.append("# HELP moon_message_wait_microseconds Time messages wait in the worker mailbox.\n");
+            content.append("# TYPE moon_message_wait_microseconds summary\n");
+            histogram_metrics(content, wait_metric, worker_labels, latency_.wait);
+            for (auto& it : services_)
+            {
+                std::string labels = moon::format(R"(worker="%u",service="%s",serviceid="%08X")", id(), it.second->name().data(), it.second->id());
+                histogram_metrics(content, wait_metric, labels, it.second->latency().wait);
+            }
+            content.append("# HELP moon_message_handle_microseconds Time services spend handling messages.\n");
+            content.append("# TYPE moon_message_handle_microseconds summary\n");
+            histogram_metrics(content, handle_metric, worker_labels, latency_.handle);
+            for (auto& it : services_)
+            {
+                std::string labels = moon::format(R"(worker="%u",service="%s",serviceid="%08X")", id(), it.second->name().data(), it.second->id());
+                histogram_metrics(content, handle_metric, labels, it.second->latency().handle);
+            }
+            content.append("# HELP moon_socket_accepted_total Connections accepted by the worker's listeners.\n");
+            content.append("# TYPE moon_socket_accepted_total counter\n");
+            content.append(moon::format("moon_socket_accepted_total{%s} %u\n", worker_labels.data(), socket_->accept_count()));
+            return content;
+            });
+
+#ifdef MOON_ENABLE_IO_URING
+        if (server_->io_uring())
+        {
+            uring_ = std::make_unique<moon::uring>(io_ctx_);
+            if (int err = uring_->open(uring::ENTRIES); err != 0)
+            {
+                CONSOLE_WARN(router_->logger(), "WORKER-%u io_uring unavailable: %s(%d), fall back to epoll", workerid_, std::strerror(err), err);
+                uring_.reset();
+            }
+        }
+#endif
+
         socket_ = std::make_unique<moon::socket>(router_, this, io_ctx_);
 
         thread_ = std::thread([this]() {
             state_.store(state::ready, std::memory_order_release);
             CONSOLE_INFO(router_->logger(), "WORKER-%u START", workerid_);
-            io_ctx_.run();
+            while (!io_ctx_.stopped())
+            {
+                if (idle_tasks_.empty())
+                {
+                    io_ctx_.run_one();
+                }
+                else if (0 == io_ctx_.poll_one())
+                {
+                    //one step when no handler is ready, then wait for handlers instead of
+                    //spinning on what is left of the task
+                    run_idle();
+                    if (!idle_tasks_.empty())
+                    {
+                        io_ctx_.run_one_for(IDLE_WAIT);
+                    }
+                }
+
+                //services ran, collect the garbage they left once the worker is idle again
+                if (!gc_scheduled_ && !gc_queue_.empty())
+                {
+                    gc_scheduled_ = true;
+                    post_idle([this] { return gc_slice(); });
+                }
+            }
+#ifdef MOON_ENABLE_IO_URING
+            //the kernel must be done with buffers and sockets before they are freed
+            if (nullptr != uring_)
+            {
+                uring_->shutdown();
+            }
+#endif
+            idle_tasks_.clear();
+            gc_queue_.clear();
+            service_slots_.clear();
             services_.clear();
             CONSOLE_INFO(router_->logger(), "WORKER-%u STOP", workerid_);
             });
@@ -121,10 +272,11 @@ namespace moon
     void worker::add_service(std::string service_type
         , std::string config
         , bool unique
+        , bool shared
         , uint32_t creatorid
         , int32_t sessionid)
     {
-        asio::post(io_ctx_, [this, service_type = std::move(service_type), config = std::move(config), unique, creatorid, sessionid](){
+        asio::post(io_ctx_, [this, service_type = std::move(service_type), config = std::move(config), unique, shared, creatorid, sessionid](){
             do
             {
                 if (state_.load(std::memory_order_acquire) != state::ready)
@@ -145,7 +297,8 @@ namespace moon
                     }
                     serviceid = uuid();
                     ++counter;
-                } while (services_.find(serviceid) != services_.end());
+                    //ids of services moved to other workers are still taken
+                } while (nullptr != find_service(serviceid) || 0 != moved_to(serviceid));
 
                 if (serviceid == 0)
                 {
@@ -158,20 +311,34 @@ namespace moon
                 s->set_id(serviceid);
                 s->logger(router_->logger());
                 s->set_unique(unique);
+                s->set_shared(shared);
                 s->set_server_context(server_, router_, this);
 
                 if (!s->init(config))
                 {
+                    unsubscribe_all(serviceid, nullptr);
                     break;
                 }
 
                 s->ok(true);
 
+                if (const auto& limit = s->mailbox(); limit)
+                {
+                    set_mailbox_limit(serviceid, limit);
+                }
+
                 auto res = services_.emplace(serviceid, std::move(s));
                 if (!res.second)
                 {
                     break;
                 }
+                service_slots_.insert(serviceid, res.first->second.get());
+
+                //unique services watch other services' exit, to fail their pending calls
+                if (unique)
+                {
+                    subscribe(TOPIC_SERVICE_EXIT, serviceid);
+                }
 
                 count_.fetch_add(1, std::memory_order_release);
 
@@ -184,7 +351,7 @@ namespace moon
 
             if (services_.empty())
             {
-                shared(true);
+                this->shared(true);
             }
 
             if (0 != sessionid)
@@ -197,23 +364,36 @@ namespace moon
     void worker::remove_service(uint32_t serviceid, uint32_t sender, uint32_t sessionid)
     {
         asio::post(io_ctx_, [this, serviceid, sender, sessionid]() {
-            if (auto s = find_service(serviceid); nullptr != s)
+            auto s = find_service(serviceid);
+            if (nullptr == s && adopt_incoming())
+            {
+                s = find_service(serviceid);
+            }
+
+            if (nullptr != s)
             {
                 count_.fetch_sub(1, std::memory_order_release);
 
                 auto content = moon::format(R"({"name":"%s","serviceid":%08X,"errmsg":"service destroy"})", s->name().data(), s->id());
                 router_->response(sender, "service destroy"sv, content, sessionid);
+                service_slots_.erase(serviceid);
                 services_.erase(serviceid);
+                unsubscribe_all(serviceid, nullptr);
+                erase_mailbox_limit(serviceid);
                 if (services_.empty()) shared(true);
 
                 if (server_->get_state() == state::ready)
                 {
-                    std::string_view header{ "_service_exit" };
                     auto buf = message::create_buffer();
                     buf->write_back(content.data(), content.size());
-                    router_->broadcast(serviceid, buf, header, PTYPE_SYSTEM);
+                    router_->broadcast(serviceid, buf, TOPIC_SERVICE_EXIT, PTYPE_SYSTEM);
                 }
             }
+            else if (uint32_t workerid = unroute(serviceid); 0 != workerid)
+            {
+                server_->get_worker(workerid)->remove_service(serviceid, sender, sessionid);
+                erase_mailbox_limit(serviceid);
+            }
             else
             {
                 router_->response(sender, "worker::remove_service "sv, moon::format("service [%08X] not found", serviceid), sessionid, PTYPE_ERROR);
@@ -233,24 +413,143 @@ namespace moon
 
     void worker::send(message_ptr_t&& msg)
     {
+        if (limited_.load(std::memory_order_acquire) != 0 && !admit(msg))
+        {
+            return;
+        }
+
         ++mqsize_;
-        if (mq_.push_back(std::move(msg)) == 1)
+        msg->set_enqueue_time(moon::time::microsecond());
+        lane l = lane_of(msg.get());
+        ++lane_size_[l];
+        mq_[l].push_back(std::move(msg));
+        wakeup();
+    }
+
+    void worker::wakeup()
+    {
+        //a queued drain swaps the lanes when it starts, so it also takes this message.
+        //the exchange pairs with the one in drain(): either this producer posts, or the
+        //drain that clears the flag sees the message
+        if (!wakeup_pending_.exchange(true, std::memory_order_acq_rel))
         {
-            asio::post(io_ctx_, [this]() {
-                if (mq_.size() == 0)
-                {
-                    return;
-                }
+            asio::post(io_ctx_, drain_handler{ this });
+        }
+    }
 
-                service* ser = nullptr;
-                mq_.swap(swapmq_);
-                for (auto& msg : swapmq_)
-                {
-                    handle_one(ser, std::move(msg));
-                    --mqsize_;
-                }
-                swapmq_.clear();
-                });
+    //responses skip the normal lane: a response (an error reply of a rejected call too)
+    //can be handled before normal messages the same sender sent earlier
+    worker::lane worker::lane_of(const message* msg) const
+    {
+        if (!server_->mailbox_lanes())
+        {
+            return lane_normal;
+        }
+
+        if (msg->sessionid() > 0)
+        {
+            return lane_response;
+        }
+
+        switch (msg->type())
+        {
+        case PTYPE_SYSTEM:
+        case PTYPE_DEBUG:
+            return lane_control;
+        default:
+            return lane_normal;
+        }
+    }
+
+    void worker::drain()
+    {
+        if (wakeup_pending_.exchange(false, std::memory_order_acquire))
+        {
+            wakeup_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        //take the normal lane before handling the others: what they send to this worker
+        //waits for the drain posted with it, as with a single queue.
+        //a batch an earlier drain left for the other lanes is continued first
+        if (drain_pos_ == swapmq_.size())
+        {
+            swapmq_.clear();
+            drain_pos_ = 0;
+            mq_[lane_normal].swap(swapmq_);
+        }
+
+        drain_priority();
+
+        service* ser = nullptr;
+        size_t weight = 0;
+        while (drain_pos_ < swapmq_.size())
+        {
+            //a flood of normal messages delays responses by NORMAL_LANE_WEIGHT messages, and
+            //a flood of responses still lets NORMAL_LANE_WEIGHT normal messages through.
+            //the rest of the batch waits behind the handlers posted meanwhile, not only the
+            //lanes: a response must not overtake the removal of the service that sent it
+            if (weight >= NORMAL_LANE_WEIGHT && (!swaplane_.empty() || !mq_[lane_response].empty() || !mq_[lane_control].empty()))
+            {
+                wakeup();
+                return;
+            }
+
+            size_t i = drain_pos_;
+            if (steal_request_.load(std::memory_order_relaxed) != 0)
+            {
+                handle_steal_request(i);
+                ser = nullptr;
+            }
+
+            size_t n = batch_count(ser, i);
+            if (n > 1)
+            {
+                handle_batch(ser, i, n);
+            }
+            else if (auto& msg = swapmq_[i]; msg)
+            {
+                handle_one(ser, std::move(msg));
+            }
+            drain_pos_ += n;
+            weight += n;
+            mqsize_ -= n;
+            lane_size_[lane_normal] -= n;
+        }
+        swapmq_.clear();
+        drain_pos_ = 0;
+    }
+
+    void worker::drain_priority()
+    {
+        swap_priority();
+        if (swaplane_.empty())
+        {
+            return;
+        }
+
+        service* ser = nullptr;
+        for (auto& msg : swaplane_)
+        {
+            //taken by a service that moved away
+            if (msg)
+            {
+                handle_one(ser, std::move(msg));
+            }
+        }
+        swaplane_.clear();
+    }
+
+    void worker::swap_priority()
+    {
+        //swap appends, so both lanes are taken at once and handled in lane order.
+        //what take_pending swapped before is still in front
+        for (lane l : {lane_response, lane_control})
+        {
+            size_t n = swaplane_.size();
+            mq_[l].swap(swaplane_);
+            n = swaplane_.size() - n;
+            mqsize_ -= static_cast<int32_t>(n);
+            lane_size_[l] -= static_cast<int32_t>(n);
         }
     }
 
@@ -261,12 +560,7 @@ namespace moon
 
     service* worker::find_service(uint32_t serviceid) const
     {
-        auto iter = services_.find(serviceid);
-        if (services_.end() != iter)
-        {
-            return iter->second.get();
-        }
-        return nullptr;
+        return service_slots_.find(serviceid);
     }
 
     void worker::on_timer(timer_t timerid, uint32_t serviceid, bool last)
@@ -283,6 +577,7 @@ namespace moon
             int64_t cost_time = moon::time::microsecond() - start_time;
             s->add_cpu_cost(cost_time);
             cpu_cost_ += cost_time;
+            mark_gc(s);
             if (cost_time > 100000)
             {
                 CONSOLE_WARN(router_->logger(),
@@ -295,6 +590,69 @@ namespace moon
         }
     }
 
+    void worker::arm_timer()
+    {
+        int64_t next = timer_.next_expiretime();
+        if (next == std::numeric_limits<int64_t>::max() || (armed_ != 0 && armed_ <= next))
+        {
+            return;
+        }
+
+        armed_ = next;
+#ifdef MOON_ENABLE_IO_URING
+        if (nullptr != uring_)
+        {
+            if (nullptr != timer_op_)
+            {
+                uring_->cancel(timer_op_);
+            }
+
+            auto op = uring_->make_op<uring_timeout_data>([this, gen = ++timer_gen_](int res) {
+                //cancelled by an earlier deadline, or it expired while being cancelled
+                if (gen != timer_gen_)
+                {
+                    return;
+                }
+                timer_op_ = nullptr;
+                if (res == -ETIME)
+                {
+                    on_precise_timer();
+                }
+            });
+            //steady_clock is CLOCK_MONOTONIC, the clock of an absolute io_uring timeout
+            auto since = time::steady_time(next).time_since_epoch();
+            auto sec = std::chrono::duration_cast<std::chrono::seconds>(since);
+            op->data.ts.tv_sec = sec.count();
+            op->data.ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(since - sec).count();
+
+            io_uring_sqe* sqe = uring_->prepare(op);
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(&op->data.ts);
+            sqe->len = 1;
+            sqe->timeout_flags = IORING_TIMEOUT_ABS;
+            timer_op_ = op;
+            return;
+        }
+#endif
+        precise_timer_.expires_at(time::steady_time(next));
+        precise_timer_.async_wait([this](const asio::error_code& e) {
+            //cancelled by an earlier deadline
+            if (e)
+            {
+                return;
+            }
+            on_precise_timer();
+        });
+    }
+
+    void worker::on_precise_timer()
+    {
+        armed_ = 0;
+        timer_.update(time::now());
+        arm_timer();
+    }
+
     void worker::runcmd(uint32_t sender, const std::string& cmd, int32_t sessionid)
     {
         asio::post(io_ctx_, [this, sender, cmd, sessionid] {
@@ -319,6 +677,7 @@ namespace moon
         auto iter = prefabs_.emplace(uuid(), std::move(buf));
         if (iter.second)
         {
+            has_prefab_.store(true, std::memory_order_relaxed);
             return iter.first->first;
         }
         return 0;
@@ -341,7 +700,13 @@ namespace moon
 
     timer_t worker::repeat(int64_t interval, int32_t times, uint32_t serviceid)
     {
-        return timer_.repeat(server_->now(), interval, times, serviceid, this);
+        if (!server_->precise_timer())
+        {
+            return timer_.repeat(server_->now(), interval, times, serviceid, this);
+        }
+        timer_t id = timer_.repeat(time::now(), interval, times, serviceid, this);
+        arm_timer();
+        return id;
     }
 
     void worker::remove_timer(timer_t id)
@@ -359,8 +724,38 @@ namespace moon
         return shared_.load();
     }
 
+    void worker::post_idle(std::function<bool()> fn)
+    {
+        idle_tasks_.emplace_back(std::move(fn));
+    }
+
+    void worker::run_idle()
+    {
+        if (idle_next_ >= idle_tasks_.size())
+        {
+            idle_next_ = 0;
+        }
+
+        //the task may post another idle task, do not hold a reference into idle_tasks_
+        auto fn = std::move(idle_tasks_[idle_next_]);
+        if (fn())
+        {
+            idle_tasks_.erase(idle_tasks_.begin() + idle_next_);
+        }
+        else
+        {
+            idle_tasks_[idle_next_++] = std::move(fn);
+        }
+    }
+
     void worker::update()
     {
+        //precise timers wake the worker by themselves, an idle worker is left asleep
+        if (server_->precise_timer() && !server_->work_stealing() && !has_prefab_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
         //update_state is true
         if (update_state_.test_and_set(std::memory_order_acquire))
         {
@@ -368,11 +763,17 @@ namespace moon
         }
 
         asio::post(io_ctx_, [this] {
-            timer_.update(server_->now());
+            if (!server_->precise_timer())
+            {
+                timer_.update(server_->now());
+            }
+
+            steal();
 
             if (!prefabs_.empty())
             {
                 prefabs_.clear();
+                has_prefab_.store(false, std::memory_order_relaxed);
             }
 
             update_state_.clear(std::memory_order_release);
@@ -385,51 +786,794 @@ namespace moon
         uint32_t receiver = msg->receiver();
         if (msg->broadcast())
         {
-            for (auto& it : services_)
+            handle_broadcast(msg);
+            return;
+        }
+
+        if (nullptr == s || s->id() != receiver)
+        {
+            s = find_service(receiver);
+            if (nullptr == s && adopt_incoming())
+            {
+                s = find_service(receiver);
+            }
+
+            if (nullptr == s)
             {
-                if (!it.second->unique() && msg->type() == PTYPE_SYSTEM)
+                if (forward(msg))
                 {
-                    continue;
+                    return;
                 }
 
-                if (it.second->ok() && it.second->id() != sender)
+                //handed over to this worker after the look above, the route to it is gone by now
+                if (adopt_incoming())
                 {
-                    it.second->handle_message(std::move(msg));
+                    s = find_service(receiver);
                 }
             }
+        }
+
+        //a service that is quitting stops taking messages before its removal is handled
+        if (nullptr == s || !s->ok())
+        {
+            if (sender != 0)
+            {
+                std::string hexdata = moon::hex_string({ msg->data(),msg->size() });
+                std::string str = moon::format("[%08X] attempt send to dead service [%08X]: %s."
+                    , sender
+                    , receiver
+                    , hexdata.data());
+
+                msg->set_sessionid(-msg->sessionid());
+                router_->response(sender, "worker::handle_one "sv, str, msg->sessionid(), PTYPE_ERROR);
+            }
+            return;
+        }
+
+        if (!consume(s, msg.get()))
+        {
             return;
         }
 
+        int64_t start_time = moon::time::microsecond();
+        record_wait(s, msg.get(), start_time);
+        s->handle_message(std::move(msg));
+        int64_t cost_time = moon::time::microsecond() - start_time;
+        s->add_cpu_cost(cost_time);
+        cpu_cost_ += cost_time;
+        record_handle(s, cost_time);
+        mark_gc(s);
+        if (cost_time > 100000)
+        {
+            CONSOLE_WARN(router_->logger(),
+                "worker %u handle one message cost %" PRId64 "us, from %08X to %08X", id(), cost_time, sender, receiver);
+        }
+        if (!server_->precise_timer())
+        {
+            timer_.update(server_->now());
+        }
+    }
+
+    size_t worker::batch_count(service*& s, size_t pos)
+    {
+        const auto& msg = swapmq_[pos];
+        if (!msg || msg->broadcast())
+        {
+            return 1;
+        }
+
+        uint32_t receiver = msg->receiver();
         if (nullptr == s || s->id() != receiver)
         {
             s = find_service(receiver);
-            if (nullptr == s || !s->ok())
+        }
+
+        if (nullptr == s || !s->ok() || !s->batch())
+        {
+            return 1;
+        }
+
+        size_t end = pos + 1;
+        while (end < swapmq_.size())
+        {
+            const auto& m = swapmq_[end];
+            if (!m || m->broadcast() || m->receiver() != receiver)
+            {
+                break;
+            }
+            ++end;
+        }
+        return end - pos;
+    }
+
+    void worker::handle_batch(service* s, size_t pos, size_t count)
+    {
+        size_t end = pos;
+        for (size_t i = pos; i < pos + count; ++i)
+        {
+            if (consume(s, swapmq_[i].get()))
             {
-                if (sender != 0)
+                if (i != end)
                 {
-                    std::string hexdata = moon::hex_string({ msg->data(),msg->size() });
-                    std::string str = moon::format("[%08X] attempt send to dead service [%08X]: %s."
-                        , sender
-                        , receiver
-                        , hexdata.data());
-
-                    msg->set_sessionid(-msg->sessionid());
-                    router_->response(sender, "worker::handle_one "sv, str, msg->sessionid(), PTYPE_ERROR);
+                    swapmq_[end] = std::move(swapmq_[i]);
                 }
-                return;
+                ++end;
             }
         }
 
+        count = end - pos;
+        if (0 == count)
+        {
+            return;
+        }
+
         int64_t start_time = moon::time::microsecond();
-        s->handle_message(std::move(msg));
+        for (size_t i = pos; i < pos + count; ++i)
+        {
+            record_wait(s, swapmq_[i].get(), start_time);
+        }
+        s->handle_messages(&swapmq_[pos], count);
         int64_t cost_time = moon::time::microsecond() - start_time;
         s->add_cpu_cost(cost_time);
         cpu_cost_ += cost_time;
+        //one Lua call for the whole batch, share its cost evenly
+        for (size_t i = 0; i < count; ++i)
+        {
+            record_handle(s, cost_time / static_cast<int64_t>(count));
+        }
+        mark_gc(s);
         if (cost_time > 100000)
         {
             CONSOLE_WARN(router_->logger(),
-                "worker %u handle one message cost %" PRId64 "us, from %08X to %08X", id(), cost_time, sender, receiver);
+                "worker %u handle %zu messages cost %" PRId64 "us, to %08X", id(), count, cost_time, s->id());
+        }
+        if (!server_->precise_timer())
+        {
+            timer_.update(server_->now());
+        }
+    }
+
+    void worker::subscribe(std::string_view topic, uint32_t serviceid)
+    {
+        auto& subscribers = topics_[std::string{ topic }];
+        if (std::find(subscribers.begin(), subscribers.end(), serviceid) == subscribers.end())
+        {
+            subscribers.emplace_back(serviceid);
+        }
+    }
+
+    void worker::unsubscribe(std::string_view topic, uint32_t serviceid)
+    {
+        if (auto iter = topics_.find(std::string{ topic }); iter != topics_.end())
+        {
+            auto& subscribers = iter->second;
+            subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), serviceid), subscribers.end());
+            if (subscribers.empty())
+            {
+                topics_.erase(iter);
+            }
+        }
+    }
+
+    void worker::unsubscribe_all(uint32_t serviceid, std::vector<std::string>* topics)
+    {
+        for (auto iter = topics_.begin(); iter != topics_.end();)
+        {
+            auto& subscribers = iter->second;
+            if (auto it = std::find(subscribers.begin(), subscribers.end(), serviceid); it != subscribers.end())
+            {
+                subscribers.erase(it);
+                if (nullptr != topics)
+                {
+                    topics->emplace_back(iter->first);
+                }
+            }
+
+            if (subscribers.empty())
+            {
+                iter = topics_.erase(iter);
+                continue;
+            }
+            ++iter;
+        }
+    }
+
+    void worker::handle_broadcast(message_ptr_t& msg)
+    {
+        //snapshot receivers, services may subscribe or unsubscribe while handling
+        receivers_.clear();
+        if (std::string_view topic = msg->header(); topic.empty())
+        {
+            for (const auto& it : services_)
+            {
+                receivers_.emplace_back(it.first);
+            }
+        }
+        else if (auto iter = topics_.find(std::string{ topic }); iter != topics_.end())
+        {
+            receivers_.assign(iter->second.begin(), iter->second.end());
+        }
+
+        uint32_t sender = msg->sender();
+        for (auto id : receivers_)
+        {
+            auto s = find_service(id);
+            if (nullptr == s || !s->ok() || id == sender)
+            {
+                continue;
+            }
+
+            //every receiver reads the same message and buffer
+            int64_t start_time = moon::time::microsecond();
+            record_wait(s, msg.get(), start_time);
+            s->handle_message(msg);
+            int64_t cost_time = moon::time::microsecond() - start_time;
+            s->add_cpu_cost(cost_time);
+            cpu_cost_ += cost_time;
+            record_handle(s, cost_time);
+            mark_gc(s);
+        }
+    }
+
+    bool worker::admit(message_ptr_t& msg)
+    {
+        if (msg->broadcast() || msg->mailbox_counted())
+        {
+            return true;
+        }
+
+        std::shared_ptr<mailbox_limit> limit;
+        {
+            std::shared_lock lock(limits_lock_);
+            if (auto iter = limits_.find(msg->receiver()); iter != limits_.end())
+            {
+                limit = iter->second;
+            }
+        }
+
+        if (!limit)
+        {
+            return true;
+        }
+
+        uint32_t pending = limit->pending.fetch_add(1, std::memory_order_relaxed);
+        if (pending >= limit->capacity && limit->policy == mailbox_policy::reject)
+        {
+            limit->pending.fetch_sub(1, std::memory_order_relaxed);
+            limit->rejected.fetch_add(1, std::memory_order_relaxed);
+            mailbox_rejected_.fetch_add(1, std::memory_order_relaxed);
+            if (msg->sessionid() < 0 && msg->sender() != 0)
+            {
+                std::string str = moon::format("[%08X] mailbox full, capacity %u.", msg->receiver(), limit->capacity);
+                router_->response(msg->sender(), "worker::send "sv, str, -msg->sessionid(), PTYPE_ERROR);
+            }
+            return false;
+        }
+
+        msg->set_mailbox_counted(true);
+        return true;
+    }
+
+    bool worker::consume(service* s, message* msg)
+    {
+        const auto& limit = s->mailbox_;
+        if (!msg->mailbox_counted() || !limit)
+        {
+            return true;
+        }
+
+        //count again if the service redirects it
+        msg->set_mailbox_counted(false);
+        uint32_t pending = limit->pending.fetch_sub(1, std::memory_order_relaxed);
+        if (limit->policy == mailbox_policy::drop_oldest && pending > limit->capacity)
+        {
+            limit->dropped.fetch_add(1, std::memory_order_relaxed);
+            mailbox_dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (msg->sessionid() < 0 && msg->sender() != 0)
+            {
+                std::string str = moon::format("[%08X] mailbox full, message dropped.", s->id());
+                router_->response(msg->sender(), "worker::handle_one "sv, str, -msg->sessionid(), PTYPE_ERROR);
+            }
+            return false;
+        }
+
+        if (limit->paused && pending - 1 <= limit->capacity / 2)
+        {
+            limit->paused = false;
+            socket_->resume_read(s->id());
+        }
+        return true;
+    }
+
+    bool worker::mailbox_full(uint32_t serviceid)
+    {
+        if (limited_.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+
+        auto s = find_service(serviceid);
+        if (nullptr == s)
+        {
+            return false;
+        }
+
+        const auto& limit = s->mailbox_;
+        if (!limit || limit->policy != mailbox_policy::backpressure
+            || limit->pending.load(std::memory_order_relaxed) < limit->capacity)
+        {
+            return false;
+        }
+
+        if (!limit->paused)
+        {
+            limit->paused = true;
+            mailbox_paused_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void worker::set_mailbox_limit(uint32_t serviceid, const std::shared_ptr<mailbox_limit>& limit)
+    {
+        std::unique_lock lock(limits_lock_);
+        limits_[serviceid] = limit;
+        limited_.store(static_cast<uint32_t>(limits_.size()), std::memory_order_release);
+    }
+
+    void worker::erase_mailbox_limit(uint32_t serviceid)
+    {
+        std::unique_lock lock(limits_lock_);
+        if (limits_.erase(serviceid) != 0)
+        {
+            limited_.store(static_cast<uint32_t>(limits_.size()), std::memory_order_release);
+        }
+    }
+
+    void worker::record_wait(service* s, const message* msg, int64_t now)
+    {
+        if (int64_t t = msg->enqueue_time(); t > 0)
+        {
+            uint64_t v = static_cast<uint64_t>(std::max<int64_t>(now - t, 0));
+            s->latency_.wait.record(v);
+            latency_.wait.record(v);
+        }
+    }
+
+    void worker::record_handle(service* s, int64_t cost_time)
+    {
+        uint64_t v = static_cast<uint64_t>(std::max<int64_t>(cost_time, 0));
+        s->latency_.handle.record(v);
+        latency_.handle.record(v);
+    }
+
+    void worker::mark_gc(service* s)
+    {
+        if (s->gc_queued_ || server_->idle_gc() <= 0)
+        {
+            return;
+        }
+        s->gc_queued_ = true;
+        gc_queue_.emplace_back(s->id());
+    }
+
+    bool worker::gc_slice()
+    {
+        if (gc_queue_.empty())
+        {
+            gc_scheduled_ = false;
+            return true;
+        }
+
+        int64_t start = time::microsecond();
+        int64_t deadline = start + server_->idle_gc();
+        int64_t now = start;
+        //at least one step a slice, a budget below one step still makes progress
+        do
+        {
+            uint32_t serviceid = gc_queue_.front();
+            gc_queue_.pop_front();
+            service* s = find_service(serviceid);
+            if (nullptr == s)
+            {
+                continue;
+            }
+
+            int64_t step_start = now;
+            bool work = s->gc_step();
+            now = time::microsecond();
+            if (!work)
+            {
+                s->gc_queued_ = false;
+                continue;
+            }
+
+            int64_t cost = now - step_start;
+            s->latency_.gc.record(static_cast<uint64_t>(cost));
+            latency_.gc.record(static_cast<uint64_t>(cost));
+            gc_steps_.fetch_add(1, std::memory_order_relaxed);
+            gc_time_.fetch_add(cost, std::memory_order_relaxed);
+            if (cost > gc_max_.load(std::memory_order_relaxed))
+            {
+                gc_max_.store(cost, std::memory_order_relaxed);
+            }
+            //the cycle is not finished, step it again after the others
+            gc_queue_.emplace_back(serviceid);
+        } while (!gc_queue_.empty() && now < deadline);
+
+        if (gc_queue_.empty())
+        {
+            gc_scheduled_ = false;
+            return true;
+        }
+        return false;
+    }
+
+    void worker::steal()
+    {
+        if (!server_->work_stealing() || !shared() || mqsize_.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
+
+        worker* victim = nullptr;
+        int32_t most = STEAL_THRESHOLD;
+        for (const auto& w : server_->get_workers())
+        {
+            if (w.get() == this)
+            {
+                continue;
+            }
+
+            if (int32_t n = w->mqsize_.load(std::memory_order_relaxed); n > most)
+            {
+                most = n;
+                victim = w.get();
+            }
+        }
+
+        if (nullptr != victim)
+        {
+            uint32_t expected = 0;
+            victim->steal_request_.compare_exchange_strong(expected, id());
+        }
+    }
+
+    void worker::handle_steal_request(size_t pos)
+    {
+        uint32_t thiefid = steal_request_.exchange(0, std::memory_order_acq_rel);
+        worker* thief = server_->get_worker(thiefid);
+        if (nullptr == thief || thief == this)
+        {
+            return;
+        }
+
+        std::unordered_map<uint32_t, size_t> pending;
+        for (size_t i = pos; i < swapmq_.size(); ++i)
+        {
+            const auto& msg = swapmq_[i];
+            if (msg && !msg->broadcast())
+            {
+                ++pending[msg->receiver()];
+            }
+        }
+
+        //moving the only busy service just moves the hot spot
+        if (pending.size() < 2)
+        {
+            return;
+        }
+
+        uint32_t serviceid = 0;
+        size_t most = 0;
+        for (const auto& it : pending)
+        {
+            if (it.second <= most)
+            {
+                continue;
+            }
+
+            auto s = find_service(it.first);
+            if (nullptr == s || !s->ok() || !s->shared() || socket_->has_owner(it.first))
+            {
+                continue;
+            }
+            serviceid = it.first;
+            most = it.second;
+        }
+
+        if (0 == serviceid)
+        {
+            return;
+        }
+
+        auto ctx = detach(serviceid);
+        stolen_count_.fetch_add(1, std::memory_order_relaxed);
+
+        CONSOLE_DEBUG(router_->logger(), "worker %u steal service %08X from worker %u, %zu messages pending", thief->id(), serviceid, id(), most);
+
+        hand_over(std::move(ctx), thief);
+    }
+
+    void worker::migrate_service(uint32_t serviceid, uint32_t workerid, uint32_t sender, int32_t sessionid)
+    {
+        asio::post(io_ctx_, [this, serviceid, workerid, sender, sessionid]() {
+            auto s = find_service(serviceid);
+            if (nullptr == s && adopt_incoming())
+            {
+                s = find_service(serviceid);
+            }
+
+            if (nullptr == s)
+            {
+                //already moved on, the worker holding it moves it again
+                if (uint32_t next = moved_to(serviceid); 0 != next)
+                {
+                    server_->get_worker(next)->migrate_service(serviceid, workerid, sender, sessionid);
+                    return;
+                }
+                router_->response(sender, "worker::migrate_service "sv, moon::format("service [%08X] not found", serviceid), sessionid, PTYPE_ERROR);
+                return;
+            }
+
+            worker* to = server_->get_worker(workerid);
+            if (nullptr == to)
+            {
+                router_->response(sender, "worker::migrate_service "sv, moon::format("worker %u not found", workerid), sessionid, PTYPE_ERROR);
+                return;
+            }
+
+            if (to == this)
+            {
+                router_->response(sender, std::string_view{}, std::to_string(workerid), sessionid);
+                return;
+            }
+
+            if (!s->ok())
+            {
+                router_->response(sender, "worker::migrate_service "sv, moon::format("service [%08X] is not running", serviceid), sessionid, PTYPE_ERROR);
+                return;
+            }
+
+            //sockets run on this worker's io_context
+            if (socket_->has_owner(serviceid))
+            {
+                router_->response(sender, "worker::migrate_service "sv, moon::format("service [%08X] owns sockets", serviceid), sessionid, PTYPE_ERROR);
+                return;
+            }
+
+            auto ctx = detach(serviceid);
+            ctx->requested = true;
+            ctx->sender = sender;
+            ctx->sessionid = sessionid;
+            migrate_out_.fetch_add(1, std::memory_order_relaxed);
+
+            CONSOLE_DEBUG(router_->logger(), "migrate service %08X from worker %u to worker %u", serviceid, id(), to->id());
+
+            hand_over(std::move(ctx), to);
+            });
+    }
+
+    void worker::locate_service(uint32_t serviceid, std::function<void(worker*)> handler)
+    {
+        asio::post(io_ctx_, [this, serviceid, handler = std::move(handler)]() mutable {
+            auto s = find_service(serviceid);
+            if (nullptr == s && adopt_incoming())
+            {
+                s = find_service(serviceid);
+            }
+
+            if (nullptr != s)
+            {
+                handler(this);
+                return;
+            }
+
+            if (uint32_t next = moved_to(serviceid); 0 != next)
+            {
+                server_->get_worker(next)->locate_service(serviceid, std::move(handler));
+                return;
+            }
+            handler(nullptr);
+            });
+    }
+
+    worker::migrate_context_ptr_t worker::detach(uint32_t serviceid)
+    {
+        auto iter = services_.find(serviceid);
+        auto ctx = std::make_unique<migrate_context>();
+        ctx->s = std::move(iter->second);
+        service_slots_.erase(serviceid);
+        services_.erase(iter);
+
+        unsubscribe_all(serviceid, &ctx->topics);
+
+        timer_.extract([serviceid](const timer_expire_policy& policy) {
+            return policy.serviceid() == serviceid;
+            }, [&ctx](timer_t id, int64_t expiretime, int64_t interval, int32_t times) {
+                ctx->timers.emplace_back(timer_state{ id, expiretime, interval, times });
+            });
+
+        count_.fetch_sub(1, std::memory_order_release);
+        if (services_.empty())
+        {
+            shared(true);
+        }
+        return ctx;
+    }
+
+    void worker::hand_over(migrate_context_ptr_t&& ctx, worker* to)
+    {
+        uint32_t serviceid = ctx->s->id();
+        worker* home = server_->get_worker(router_->worker_id(serviceid));
+        {
+            //the home worker routes the messages under its lock: what it sent here before is
+            //taken along, what it sends after goes to the new worker. a service moved back to a
+            //worker it was on must not find older messages still on their way behind it
+            std::lock_guard lock(home->forwards_lock_);
+            take_pending(serviceid, ctx->messages);
+            to->adopt(std::move(ctx));
+            if (to == home)
+            {
+                home->forwards_.erase(serviceid);
+            }
+            else if (home == this || home->forwards_.find(serviceid) != home->forwards_.end())
+            {
+                //no route once the home worker started to remove it
+                home->forwards_[serviceid] = to->id();
+            }
+        }
+
+        if (home != this)
+        {
+            std::lock_guard lock(forwards_lock_);
+            forwards_[serviceid] = to->id();
+        }
+    }
+
+    void worker::take_pending(uint32_t serviceid, std::vector<message_ptr_t>& messages)
+    {
+        auto take = [serviceid, &messages](message_ptr_t& msg) {
+            if (msg && !msg->broadcast() && msg->receiver() == serviceid)
+            {
+                messages.emplace_back(std::move(msg));
+            }
+        };
+
+        //the rest stays for the drain that is queued for it, in the same order
+        swap_priority();
+        for (auto& msg : swaplane_)
+        {
+            take(msg);
+        }
+
+        if (drain_pos_ == swapmq_.size())
+        {
+            swapmq_.clear();
+            drain_pos_ = 0;
+        }
+        mq_[lane_normal].swap(swapmq_);
+        for (size_t i = drain_pos_; i < swapmq_.size(); ++i)
+        {
+            take(swapmq_[i]);
+        }
+    }
+
+    void worker::adopt(migrate_context_ptr_t&& ctx)
+    {
+        {
+            std::lock_guard lock(incoming_lock_);
+            incoming_.emplace_back(std::move(ctx));
+            has_incoming_.store(true, std::memory_order_release);
+        }
+
+        asio::post(io_ctx_, [this] {
+            adopt_incoming();
+        });
+    }
+
+    bool worker::adopt_incoming()
+    {
+        if (!has_incoming_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        std::vector<migrate_context_ptr_t> incoming;
+        {
+            std::lock_guard lock(incoming_lock_);
+            incoming.swap(incoming_);
+            has_incoming_.store(false, std::memory_order_release);
+        }
+
+        for (auto& ctx : incoming)
+        {
+            uint32_t serviceid = ctx->s->id();
+            ctx->s->set_server_context(server_, router_, this);
+            ctx->s->on_migrate();
+
+            bool precise = server_->precise_timer();
+            int64_t now = precise ? time::now() : server_->now();
+            for (const auto& t : ctx->timers)
+            {
+                if (!timer_.insert(now, t.id, t.expiretime, t.interval, t.times, serviceid, this))
+                {
+                    CONSOLE_ERROR(router_->logger(), "worker %u adopt service %08X timer %u failed: timerid repeated", id(), serviceid, t.id);
+                }
+            }
+
+            if (precise && !ctx->timers.empty())
+            {
+                arm_timer();
+            }
+
+            for (const auto& topic : ctx->topics)
+            {
+                subscribe(topic, serviceid);
+            }
+
+            unroute(serviceid);
+            //a service bound to its worker keeps the new one out of the round robin, as router::new_service does
+            if (!ctx->s->shared())
+            {
+                shared(false);
+            }
+            if (const auto& limit = ctx->s->mailbox(); limit)
+            {
+                set_mailbox_limit(serviceid, limit);
+            }
+            //an entry left in the old worker's gc queue is stepped there no more
+            ctx->s->gc_queued_ = false;
+            mark_gc(ctx->s.get());
+            service_slots_.insert(serviceid, ctx->s.get());
+            services_.emplace(serviceid, std::move(ctx->s));
+            count_.fetch_add(1, std::memory_order_release);
+            if (ctx->requested)
+            {
+                migrate_in_.fetch_add(1, std::memory_order_relaxed);
+                router_->response(ctx->sender, std::string_view{}, std::to_string(id()), ctx->sessionid);
+            }
+            else
+            {
+                steal_count_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            service* ser = nullptr;
+            for (auto& msg : ctx->messages)
+            {
+                handle_one(ser, std::move(msg));
+            }
+        }
+        return !incoming.empty();
+    }
+
+    bool worker::forward(message_ptr_t& msg)
+    {
+        std::lock_guard lock(forwards_lock_);
+        if (auto iter = forwards_.find(msg->receiver()); iter != forwards_.end())
+        {
+            server_->get_worker(iter->second)->send(std::move(msg));
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t worker::moved_to(uint32_t serviceid)
+    {
+        std::lock_guard lock(forwards_lock_);
+        auto iter = forwards_.find(serviceid);
+        return iter != forwards_.end() ? iter->second : 0;
+    }
+
+    uint32_t worker::unroute(uint32_t serviceid)
+    {
+        std::lock_guard lock(forwards_lock_);
+        auto iter = forwards_.find(serviceid);
+        if (iter == forwards_.end())
+        {
+            return 0;
         }
-        timer_.update(server_->now());
+        uint32_t workerid = iter->second;
+        forwards_.erase(iter);
+        return workerid;
     }
 }
@@ -1,9 +1,14 @@
 #pragma once
 #include "config.hpp"
-#include "common/concurrent_queue.hpp"
+#include "common/mpsc_queue.hpp"
 #include "common/spinlock.hpp"
+#include "common/rwlock.hpp"
 #include "common/timer.hpp"
+#include "common/histogram.hpp"
+#include "common/slot_table.hpp"
+#include "common/handler_memory.hpp"
 #include "network/socket.h"
+#include "network/uring.h"
 
 namespace moon
 {
@@ -12,7 +17,7 @@ namespace moon
 
     class worker
     {
-        using queue_t = concurrent_queue<message_ptr_t, std::mutex, std::vector>;
+        using queue_t = mpsc_queue<message>;
 
         using command_hander_t = std::function<std::string(const std::vector<std::string_view>&)>;
 
@@ -28,11 +33,78 @@ namespace moon
             {
                 worker_->on_timer(id, serviceid_, last);
             }
+
+            uint32_t serviceid() const
+            {
+                return serviceid_;
+            }
         private:
             uint32_t serviceid_;
             worker* worker_;
         };
 
+        struct timer_state
+        {
+            timer_t id;
+            int64_t expiretime;
+            int64_t interval;
+            int32_t times;
+        };
+
+        //a service moving to another worker, with its timers and not yet handled messages
+        struct migrate_context
+        {
+            service_ptr_t s;
+            std::vector<timer_state> timers;
+            std::vector<message_ptr_t> messages;
+            std::vector<std::string> topics;
+            //moved by worker::migrate_service, the requester is answered once the service is adopted
+            bool requested = false;
+            uint32_t sender = 0;
+            int32_t sessionid = 0;
+        };
+
+        using migrate_context_ptr_t = std::unique_ptr<migrate_context>;
+
+        //mailbox lanes in drain order. responses go before control messages: the exit notice
+        //of a service must not overtake the responses it sent before it quit
+        enum lane : uint8_t
+        {
+            lane_response,
+            lane_control,
+            lane_normal,
+            lane_count
+        };
+
+        //normal messages handled between two looks at the other lanes
+        static constexpr size_t NORMAL_LANE_WEIGHT = 64;
+
+        //longest wait for a handler between two idle task steps
+        static constexpr std::chrono::milliseconds IDLE_WAIT{ 1 };
+
+        //mailbox drain posted to io_ctx_. wakeup_pending_ keeps at most one queued,
+        //so it takes the worker's handler slot instead of a heap allocation
+        class drain_handler
+        {
+        public:
+            using allocator_type = handler_allocator<drain_handler>;
+
+            explicit drain_handler(worker* wk)
+                :worker_(wk){}
+
+            allocator_type get_allocator() const noexcept
+            {
+                return allocator_type{ &worker_->drain_memory_ };
+            }
+
+            void operator()() const
+            {
+                worker_->drain();
+            }
+        private:
+            worker* worker_;
+        };
+
     public:
         static constexpr uint16_t max_uuid = 0xFFFF;
 
@@ -50,6 +122,14 @@ namespace moon
 
         void remove_service(uint32_t serviceid, uint32_t sender, uint32_t sessionid);
 
+        //move the service to another worker, with its timers and subscriptions. messages still on
+        //their way to this worker are forwarded in order. sender gets the result
+        void migrate_service(uint32_t serviceid, uint32_t workerid, uint32_t sender, int32_t sessionid);
+
+        //find the worker the service runs on, following services moved away from this one.
+        //handler is called on that worker's thread, with null if the service is gone
+        void locate_service(uint32_t serviceid, std::function<void(worker*)> handler);
+
         asio::io_context& io_context();
 
         uint32_t id() const;
@@ -59,6 +139,7 @@ namespace moon
         void add_service(std::string service_type
             , std::string config
             , bool unique
+            , bool shared
             , uint32_t creatorid
             , int32_t sessionid);
 
@@ -82,10 +163,22 @@ namespace moon
         timer_t repeat(int64_t interval, int32_t times, uint32_t serviceid);
 
         void remove_timer(timer_t id);
+
+        //only called in this worker's thread
+        void subscribe(std::string_view topic, uint32_t serviceid);
+
+        void unsubscribe(std::string_view topic, uint32_t serviceid);
     
         moon::socket& socket() { return *socket_; }
 
         std::string info();
+
+        //backpressure policy: the service's mailbox reached its capacity. worker thread only
+        bool mailbox_full(uint32_t serviceid);
+
+        //fn runs on this worker's thread when no handler is ready, one call per idle moment
+        //until it returns true. worker thread only
+        void post_idle(std::function<bool()> fn);
     private:
         void run();
 
@@ -97,11 +190,86 @@ namespace moon
     private:
         void update();
 
+        lane lane_of(const message* msg) const;
+
+        //post a drain unless one is already queued
+        void wakeup();
+
+        void drain();
+
+        //handle everything waiting in the response and control lanes
+        void drain_priority();
+
         void handle_one(service*& ser, message_ptr_t&& msg);
 
+        void handle_broadcast(message_ptr_t& msg);
+
+        //number of consecutive messages from pos that go to one batch-enabled service
+        size_t batch_count(service*& ser, size_t pos);
+
+        void handle_batch(service* ser, size_t pos, size_t count);
+
+        //count msg into a bounded mailbox, false if it is rejected
+        bool admit(message_ptr_t& msg);
+
+        //msg leaves the bounded mailbox of s, false if it is dropped
+        bool consume(service* s, message* msg);
+
+        void set_mailbox_limit(uint32_t serviceid, const std::shared_ptr<mailbox_limit>& limit);
+
+        void erase_mailbox_limit(uint32_t serviceid);
+
+        void record_wait(service* ser, const message* msg, int64_t now);
+
+        void record_handle(service* ser, int64_t cost_time);
+
+        void unsubscribe_all(uint32_t serviceid, std::vector<std::string>* topics);
+
         service* find_service(uint32_t serviceid) const;
 
         void on_timer(timer_t timerid, uint32_t serviceid, bool last);
+
+        //precise timer mode: wait on the kernel timer for the nearest deadline of timer_
+        void arm_timer();
+
+        void on_precise_timer();
+
+        void steal();
+
+        void handle_steal_request(size_t pos);
+
+        //take the service out of this worker, hand_over moves it on
+        migrate_context_ptr_t detach(uint32_t serviceid);
+
+        //give the detached service to another worker with what is waiting for it here.
+        //messages to it are routed to that worker from now on
+        void hand_over(migrate_context_ptr_t&& ctx, worker* to);
+
+        //move the messages for the service out of the mailbox, in the order a drain handles them
+        void take_pending(uint32_t serviceid, std::vector<message_ptr_t>& messages);
+
+        //move the response and control lanes to swaplane_
+        void swap_priority();
+
+        void adopt(migrate_context_ptr_t&& ctx);
+
+        bool adopt_incoming();
+
+        bool forward(message_ptr_t& msg);
+
+        //worker the service moved to from this one, 0 if none
+        uint32_t moved_to(uint32_t serviceid);
+
+        //forget where the service moved to, return that worker or 0
+        uint32_t unroute(uint32_t serviceid);
+
+        void run_idle();
+
+        //queue the service for an idle gc step, it ran since its last one
+        void mark_gc(service* s);
+
+        //one idle slice of garbage collection steps, true when every queued service was collected
+        bool gc_slice();
     private:
         std::atomic<state> state_ = state::init;
         std::atomic_bool shared_ = true;
@@ -110,20 +278,75 @@ namespace moon
         std::atomic_uint32_t count_ = 0;
         uint32_t uuid_ = 0;
         int64_t cpu_cost_ = 0;
+        latency_stats latency_;
         std::atomic_int32_t mqsize_ = 0;
+        std::atomic_int32_t lane_size_[lane_count] = {};
+        //a drain is queued that has not started yet: it takes whatever is sent meanwhile
+        std::atomic_bool wakeup_pending_ = false;
+        std::atomic_uint32_t wakeup_count_ = 0;
+        //id of the idle worker asking this worker for a service
+        std::atomic_uint32_t steal_request_ = 0;
+        std::atomic_uint32_t steal_count_ = 0;
+        std::atomic_uint32_t stolen_count_ = 0;
+        std::atomic_uint32_t migrate_in_ = 0;
+        std::atomic_uint32_t migrate_out_ = 0;
+        std::atomic_bool has_incoming_ = false;
+        std::atomic_uint32_t limited_ = 0;
+        std::atomic_uint32_t mailbox_dropped_ = 0;
+        std::atomic_uint32_t mailbox_rejected_ = 0;
+        std::atomic_uint32_t mailbox_paused_ = 0;
+        //idle gc since the last info()
+        std::atomic_uint32_t gc_steps_ = 0;
+        std::atomic_int64_t gc_time_ = 0;
+        std::atomic_int64_t gc_max_ = 0;
         uint32_t workerid_;
         router*  router_;
         server*  server_;
         asio::io_context io_ctx_;
         asio_work_t work_;
         std::thread thread_;
-        queue_t mq_;
+        queue_t mq_[lane_count];
+        //normal lane being drained, handled up to drain_pos_
         queue_t::container_type swapmq_;
+        size_t drain_pos_ = 0;
+        queue_t::container_type swaplane_;
+        handler_memory drain_memory_;
         base_timer<timer_expire_policy> timer_;
+        asio::steady_timer precise_timer_;
+        //deadline precise_timer_ waits for, 0 if not armed
+        int64_t armed_ = 0;
+        std::atomic_bool has_prefab_ = false;
+#ifdef MOON_ENABLE_IO_URING
+        //sockets and the precise timer of this worker, null when the server runs on epoll
+        std::unique_ptr<moon::uring> uring_;
+        //timeout request for armed_, and how many were armed so far to tell stale completions apart
+        uring_op* timer_op_ = nullptr;
+        uint64_t timer_gen_ = 0;
+#endif
         std::unique_ptr<moon::socket> socket_;
+        spin_lock incoming_lock_;
+        std::vector<migrate_context_ptr_t> incoming_;
         std::unordered_map<uint32_t, service_ptr_t> services_;
+        //lookup index of services_
+        slot_table<service> service_slots_;
+        //serviceid -> workerid, services moved away from this worker. the worker in the id routes
+        //the messages to where the service runs, the others only follow the services they held.
+        //written by the worker a service of this one leaves, under forwards_lock_
+        spin_lock forwards_lock_;
+        std::unordered_map<uint32_t, uint32_t> forwards_;
+        //bounded mailboxes of services on (or moved away from) this worker, read by senders
+        mutable rwlock limits_lock_;
+        std::unordered_map<uint32_t, std::shared_ptr<mailbox_limit>> limits_;
         std::unordered_map<uint32_t, moon::buffer_ptr_t> prefabs_;
+        //topic -> subscribed services of this worker
+        std::unordered_map<std::string, std::vector<uint32_t>> topics_;
+        std::vector<uint32_t> receivers_;
         std::unordered_map<std::string_view, command_hander_t> commands_;
+        std::vector<std::function<bool()>> idle_tasks_;
+        size_t idle_next_ = 0;
+        bool gc_scheduled_ = false;
+        //services that ran since their last gc step
+        std::deque<uint32_t> gc_queue_;
     };
 };
 
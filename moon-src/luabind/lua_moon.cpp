@@ -220,6 +220,36 @@ static int lmoon_send(lua_State* L)
     return 0;
 }
 
+static int lmoon_publish(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    std::string_view topic = luaL_check_stringview(L, 1);
+    buffer_ptr_t buf = moon_to_buffer(L, 2);
+    int8_t type = (int8_t)luaL_checkinteger(L, 3);
+    if (!buf)
+    {
+        buf = moon::message::create_buffer(0);
+    }
+    S->get_router()->broadcast(S->id(), buf, topic, type);
+    return 0;
+}
+
+static int lmoon_subscribe(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    std::string_view topic = luaL_check_stringview(L, 1);
+    S->get_worker()->subscribe(topic, S->id());
+    return 0;
+}
+
+static int lmoon_unsubscribe(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    std::string_view topic = luaL_check_stringview(L, 1);
+    S->get_worker()->unsubscribe(topic, S->id());
+    return 0;
+}
+
 static int lmoon_new_service(lua_State* L)
 {
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
@@ -237,10 +267,26 @@ static int lmoon_kill(lua_State* L)
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
     uint32_t serviceid = (uint32_t)luaL_checkinteger(L, 1);
     int32_t sessionid = (int32_t)luaL_checkinteger(L, 2);
+    //the removal runs in a later handler, and with several workers a message sent after
+    //this one is handled can be drained before it. stop taking messages from now on
+    if (serviceid == S->id())
+    {
+        S->ok(false);
+    }
     S->get_router()->remove_service(serviceid, S->id(), sessionid);
     return 0;
 }
 
+static int lmoon_migrate(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    uint32_t serviceid = (uint32_t)luaL_checkinteger(L, 1);
+    uint32_t workerid = (uint32_t)luaL_checkinteger(L, 2);
+    int32_t sessionid = (int32_t)luaL_checkinteger(L, 3);
+    S->get_router()->migrate_service(serviceid, workerid, S->id(), sessionid);
+    return 0;
+}
+
 static int lmoon_runcmd(lua_State* L)
 {
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
@@ -254,7 +300,7 @@ static int lmoon_queryservice(lua_State* L)
 {
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
     std::string_view name = luaL_check_stringview(L, 1);
-    uint32_t id = S->get_router()->get_unique_service(std::string{ name });
+    uint32_t id = S->get_router()->get_unique_service(name);
     lua_pushinteger(L, id);
     return 1;
 }
@@ -264,7 +310,7 @@ static int lmoon_setenv(lua_State* L)
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
     std::string_view name = luaL_check_stringview(L, 1);
     std::string_view value = luaL_check_stringview(L, 2);
-    S->get_router()->set_env(std::string{ name }, std::string{ value });
+    S->get_router()->set_env(name, std::string{ value });
     return 0;
 }
 
@@ -272,8 +318,56 @@ static int lmoon_getenv(lua_State* L)
 {
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
     std::string_view name = luaL_check_stringview(L, 1);
-    std::string value = S->get_router()->get_env(std::string{ name });
-    lua_pushlstring(L, value.data(), value.size());
+    if (auto value = S->get_router()->find_env(name); nullptr != value)
+    {
+        lua_pushlstring(L, value->data(), value->size());
+    }
+    else
+    {
+        lua_pushliteral(L, "");
+    }
+    return 1;
+}
+
+static int lmoon_registry_version(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    lua_pushinteger(L, (lua_Integer)S->get_router()->registry_version());
+    return 1;
+}
+
+static int lmoon_vm_pool(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    std::string_view name = luaL_check_stringview(L, 1);
+    size_t size = (size_t)luaL_checkinteger(L, 2);
+    size_t memlimit = (size_t)luaL_optinteger(L, 3, 0);
+    std::vector<std::string> modules;
+    if (!lua_isnoneornil(L, 4))
+    {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        lua_Integer n = luaL_len(L, 4);
+        for (lua_Integer i = 1; i <= n; ++i)
+        {
+            lua_rawgeti(L, 4, i);
+            modules.emplace_back(luaL_check_stringview(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    bool ok = lua_service::make_vm_pool(S->get_server(), std::string{ name }, size, memlimit, std::move(modules));
+    lua_pushboolean(L, ok ? 1 : 0);
+    return 1;
+}
+
+static int lmoon_memory(lua_State* L)
+{
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    lua_pushinteger(L, (lua_Integer)S->mem);
+    if (size_t reserved = S->reserved_memory(); reserved > 0)
+    {
+        lua_pushinteger(L, (lua_Integer)reserved);
+        return 2;
+    }
     return 1;
 }
 
@@ -302,6 +396,12 @@ static int lmoon_size(lua_State* L)
     return 1;
 }
 
+static int lmoon_pool_allocated(lua_State* L)
+{
+    lua_pushinteger(L, (lua_Integer)moon::message::pool_allocated());
+    return 1;
+}
+
 static int lmoon_now(lua_State* L)
 {
     lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
@@ -328,6 +428,22 @@ static int lmoon_callback(lua_State* L) {
     return 0;
 }
 
+static int lmoon_batch_callback(lua_State* L) {
+    lua_service* S = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    if (lua_isnoneornil(L, 1))
+    {
+        S->set_batch(false);
+        return 0;
+    }
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_settop(L, 1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, lua_service::batch_callback_key());
+    lua_createtable(L, 64, 1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, lua_service::batch_array_key());
+    S->set_batch(true);
+    return 0;
+}
+
 static int message_decode(lua_State* L)
 {
     message* m = (message*)lua_touserdata(L, 1);
@@ -477,18 +593,27 @@ extern "C"
             { "make_prefab", lmoon_make_prefab},
             { "send_prefab", lmoon_send_prefab},
             { "send", lmoon_send},
+            { "publish", lmoon_publish},
+            { "subscribe", lmoon_subscribe},
+            { "unsubscribe", lmoon_unsubscribe},
             { "new_service", lmoon_new_service},
             { "kill", lmoon_kill},
+            { "migrate", lmoon_migrate},
             { "runcmd", lmoon_runcmd},
             { "queryservice", lmoon_queryservice},
             { "set_env", lmoon_setenv},
             { "get_env", lmoon_getenv},
+            { "registry_version", lmoon_registry_version},
+            { "vm_pool", lmoon_vm_pool},
+            { "memory", lmoon_memory},
             { "wstate", lmoon_wstate},
             { "exit", lmoon_exit},
             { "size", lmoon_size},
+            { "pool_allocated", lmoon_pool_allocated},
             { "now", lmoon_now},
             { "adjtime", lmoon_adjtime},
             { "callback", lmoon_callback},
+            { "batch_callback", lmoon_batch_callback},
             { "decode", message_decode},
             { "clone", message_clone },
             { "release", message_release },
@@ -511,6 +636,14 @@ extern "C"
         lua_pushinteger(L, moon::time::timezone());
         lua_rawset(L, -3);
         luaL_setfuncs(L, l, 0);
+
+        //lua_service::dispatch keeps version current, lookups cached in lua compare it without a C call
+        lua_createtable(L, 0, 1);
+        lua_pushinteger(L, (lua_Integer)S->get_router()->registry_version());
+        lua_setfield(L, -2, "version");
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, lua_service::registry_state_key());
+        lua_setfield(L, -2, "registry_state");
         return 1;
     }
 }
@@ -537,6 +670,29 @@ static int lasio_listen(lua_State* L)
     return 1;
 }
 
+static int lasio_listen_sharded(lua_State* L)
+{
+    lua_service* LS = (lua_service*)get_ptr(L, LMOON_GLOBAL);
+    moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
+    std::string_view host = luaL_check_stringview(L, 1);
+    uint16_t port = (uint16_t)luaL_checkinteger(L, 2);
+    uint8_t type = (uint8_t)luaL_checkinteger(L, 3);
+    std::vector<uint32_t> owners;
+    if (lua_type(L, 4) == LUA_TTABLE)
+    {
+        lua_Integer n = luaL_len(L, 4);
+        for (lua_Integer i = 1; i <= n; ++i)
+        {
+            lua_rawgeti(L, 4, i);
+            owners.push_back((uint32_t)luaL_checkinteger(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+    uint32_t fd = S->listen_sharded(std::string{ host }, port, LS->id(), type, std::move(owners));
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
 static int lasio_accept(lua_State* L)
 {
     moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
@@ -602,6 +758,48 @@ static int lasio_write_message(lua_State* L)
     return 1;
 }
 
+static constexpr const char* WS_FRAME_METANAME = "lasio_ws_frame";
+
+static int lasio_ws_frame_release(lua_State* L)
+{
+    auto* frame = (buffer_ptr_t*)luaL_checkudata(L, 1, WS_FRAME_METANAME);
+    frame->~buffer_ptr_t();
+    return 0;
+}
+
+static int lasio_ws_frame(lua_State* L)
+{
+    auto data = moon_to_buffer(L, 1);
+    if (nullptr == data)
+    {
+        return luaL_error(L, "asio.ws_frame param 'data' invalid");
+    }
+    int flag = (int)luaL_optinteger(L, 2, 0);
+    if (flag != 0 && flag != (int)buffer_flag::ws_text && flag != (int)buffer_flag::ws_ping && flag != (int)buffer_flag::ws_pong)
+    {
+        return luaL_error(L, "asio.ws_frame param 'flag' invalid");
+    }
+    void* p = lua_newuserdatauv(L, sizeof(buffer_ptr_t), 0);
+    new (p) buffer_ptr_t(moon::socket::make_ws_frame(std::move(data), (moon::buffer_flag)flag));
+    if (luaL_newmetatable(L, WS_FRAME_METANAME))//mt
+    {
+        lua_pushcfunction(L, lasio_ws_frame_release);
+        lua_setfield(L, -2, "__gc");//mt[__gc] = lasio_ws_frame_release
+    }
+    lua_setmetatable(L, -2);// set userdata metatable
+    return 1;
+}
+
+static int lasio_write_frame(lua_State* L)
+{
+    moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
+    uint32_t fd = (uint32_t)luaL_checkinteger(L, 1);
+    auto* frame = (buffer_ptr_t*)luaL_checkudata(L, 2, WS_FRAME_METANAME);
+    bool ok = S->write(fd, *frame);
+    lua_pushboolean(L, ok ? 1 : 0);
+    return 1;
+}
+
 static int lasio_close(lua_State* L)
 {
     moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
@@ -640,6 +838,16 @@ static int lasio_set_enable_chunked(lua_State* L)
     return 1;
 }
 
+static int lasio_set_framing(lua_State* L)
+{
+    moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
+    uint32_t fd = (uint32_t)luaL_checkinteger(L, 1);
+    std::string_view mode = luaL_check_stringview(L, 2);
+    bool ok = S->set_framing(fd, mode);
+    lua_pushboolean(L, ok ? 1 : 0);
+    return 1;
+}
+
 static int lasio_set_send_queue_limit(lua_State* L)
 {
     moon::socket* S = (moon::socket*)get_ptr(L, LASIO_GLOBAL);
@@ -668,15 +876,19 @@ extern "C"
         luaL_Reg l[] = {
             { "try_open", lasio_try_open},
             { "listen", lasio_listen },
+            { "listen_sharded", lasio_listen_sharded },
             { "accept", lasio_accept },
             { "connect", lasio_connect },
             { "read", lasio_read},
             { "write", lasio_write},
             { "write_message", lasio_write_message},
+            { "ws_frame", lasio_ws_frame},
+            { "write_frame", lasio_write_frame},
             { "close", lasio_close},
             { "settimeout", lasio_settimeout},
             { "setnodelay", lasio_setnodelay},
             { "set_enable_chunked", lasio_set_enable_chunked},
+            { "set_framing", lasio_set_framing},
             { "set_send_queue_limit", lasio_set_send_queue_limit},
             { "getaddress", lasio_address},
             {NULL,NULL}
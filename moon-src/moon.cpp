@@ -113,7 +113,7 @@ void usage(void) {
 #define REGISTER_CUSTOM_LIBRARY(name, lua_c_fn)\
             int lua_c_fn(lua_State* L);\
 \
-            moon::requiref(L, name, lua_c_fn);\
+            moon::preload(L, name, lua_c_fn);\
 
 
 extern "C"
@@ -293,6 +293,11 @@ int main(int argc, char* argv[])
             server_->logger()->set_level(c->loglevel);
             server_->logger()->set_enable_console(enable_console);
 
+            server_->set_work_stealing(c->work_stealing);
+            server_->set_precise_timer(c->precise_timer);
+            server_->set_idle_gc(c->idle_gc);
+            server_->set_mailbox_lanes(c->mailbox_lanes);
+            server_->set_io_uring(c->io_uring);
             server_->init(c->thread, c->log);
 
             router_->new_service("lua", moon::format(R"({"name": "bootstrap","file":"%s"})",c->bootstrap.data()), false, 0,  0, 0);
@@ -15,6 +15,14 @@ namespace moon
     {
         int32_t node = 0;
         int32_t thread = 0;
+        bool work_stealing = false;
+        bool precise_timer = false;
+        //microseconds of each worker idle slice spent on Lua GC steps, 0 leaves GC to allocations
+        int32_t idle_gc = 0;
+        //responses and system messages skip ahead of bulk messages in worker mailboxes
+        bool mailbox_lanes = false;
+        //worker sockets and precise timers go through io_uring, needs a build with MOON_ENABLE_IO_URING
+        bool io_uring = false;
         std::string loglevel;
         std::string name;
         std::string bootstrap;
@@ -51,6 +59,11 @@ namespace moon
                     scfg.name = rapidjson::get_value<std::string>(&c, "name");//server name
                     MOON_CHECK(!scfg.name.empty(), "Server config format error:must has name");
                     scfg.thread = rapidjson::get_value<int32_t>(&c, "thread", std::thread::hardware_concurrency());
+                    scfg.work_stealing = rapidjson::get_value<bool>(&c, "work_stealing", false);
+                    scfg.precise_timer = rapidjson::get_value<bool>(&c, "precise_timer", false);
+                    scfg.idle_gc = rapidjson::get_value<int32_t>(&c, "idle_gc", 0);
+                    scfg.mailbox_lanes = rapidjson::get_value<bool>(&c, "mailbox_lanes", false);
+                    scfg.io_uring = rapidjson::get_value<bool>(&c, "io_uring", false);
                     scfg.log = rapidjson::get_value<std::string>(&c, "log");
                     scfg.bootstrap = rapidjson::get_value<std::string>(&c, "bootstrap");
                     MOON_CHECK(!scfg.bootstrap.empty(), "Server config format error:must has bootstrap file");
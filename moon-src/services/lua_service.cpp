@@ -6,6 +6,8 @@
 #include "rapidjson/document.h"
 #include "service_config.hpp"
 #include "server_config.hpp"
+#include "common/lua_utility.hpp"
+#include <mutex>
 
 
 #ifdef MOON_ENABLE_MIMALLOC
@@ -22,6 +24,7 @@ extern "C"
 {
     int lua_json_decode(lua_State* L, const char*, size_t);
     void open_custom_libraries(lua_State* L);
+    int luaopen_moon(lua_State* L);
 }
 
 static int traceback(lua_State* L) {
@@ -62,6 +65,11 @@ void *lua_service::lalloc(void *ud, void *ptr, size_t osize, size_t nsize)
                                moon::format("%s Memory warning %.2f M", l->name().data(), (float)l->mem / mb_memory), l->id());
     }
 
+    if (l->arena_)
+    {
+        return l->arena_->reallocate(ptr, osize, nsize);
+    }
+
     if (nsize == 0)
     {
         free(ptr);
@@ -73,14 +81,222 @@ void *lua_service::lalloc(void *ud, void *ptr, size_t osize, size_t nsize)
     }
 }
 
+/*
+    Pre-initialized lua_States for services created with config "vmpool": name.
+    A pooled state has the libraries opened, the search paths set and the pool's modules
+    required, but no service bound to it: mooncore is kept out because it captures the
+    service's id and name. Each worker thread keeps its own states and builds replacements
+    for the taken ones in its idle time, one state per idle moment.
+    A state that ran service code is never reused, nothing guarantees it can be brought
+    back to a clean baseline (globals, registry refs, pending coroutines), its service
+    frees it and the pool builds a fresh one off the spawn path.
+*/
+namespace
+{
+    struct vm_pool_config
+    {
+        size_t size = 0;
+        size_t memlimit = 0;
+        std::vector<std::string> modules;
+    };
+
+    struct pooled_state
+    {
+        lua_State* L = nullptr;
+        size_t mem = 0;
+    };
+
+    struct vm_pool
+    {
+        std::shared_ptr<const vm_pool_config> conf;
+        std::vector<std::unique_ptr<pooled_state>> states;
+        size_t mem = 0;
+        bool filling = false;
+
+        vm_pool() = default;
+
+        vm_pool(const vm_pool&) = delete;
+
+        vm_pool& operator=(const vm_pool&) = delete;
+
+        ~vm_pool()
+        {
+            for (auto& ps : states)
+            {
+                lua_close(ps->L);
+            }
+        }
+    };
+
+    std::mutex vm_pool_lock;
+    std::unordered_map<std::string, std::shared_ptr<const vm_pool_config>> vm_pool_configs;
+    thread_local std::unordered_map<std::string, vm_pool> vm_pools;
+
+    std::shared_ptr<const vm_pool_config> find_vm_pool_config(const std::string& name)
+    {
+        std::lock_guard lock(vm_pool_lock);
+        if (auto iter = vm_pool_configs.find(name); iter != vm_pool_configs.end())
+        {
+            return iter->second;
+        }
+        return nullptr;
+    }
+
+    void* pool_alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+    {
+        pooled_state* ps = reinterpret_cast<pooled_state*>(ud);
+        ps->mem += nsize;
+        if (ptr)
+            ps->mem -= osize;
+
+        if (nsize == 0)
+        {
+            free(ptr);
+            return nullptr;
+        }
+        return realloc(ptr, nsize);
+    }
+
+    std::unique_ptr<pooled_state> make_pooled_state(const std::string& name, const vm_pool_config& conf, router* r)
+    {
+        auto ps = std::make_unique<pooled_state>();
+        lua_State* L = lua_newstate(pool_alloc, ps.get());
+        if (nullptr == L)
+        {
+            return nullptr;
+        }
+        ps->L = L;
+
+        lua_gc(L, LUA_GCSTOP, 0);
+        lua_gc(L, LUA_GCGEN, 0, 0);
+        luaL_openlibs(L);
+
+        int ok = (luaL_dostring(L, r->get_env("CPATH").data()) == LUA_OK);
+        ok = ok && (luaL_dostring(L, r->get_env("PATH").data()) == LUA_OK);
+        if (ok)
+        {
+            open_custom_libraries(L);
+            //the pool's modules load without mooncore
+            luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+            lua_pushnil(L);
+            lua_setfield(L, -2, "mooncore");
+            lua_pop(L, 1);
+
+            for (const auto& m : conf.modules)
+            {
+                lua_getglobal(L, "require");
+                lua_pushlstring(L, m.data(), m.size());
+                if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+                {
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+
+        if (!ok)
+        {
+            const char* err = lua_tostring(L, -1);
+            CONSOLE_ERROR(r->logger(), "vmpool %s init state failed: %s", name.data(), err ? err : "");
+            lua_close(L);
+            return nullptr;
+        }
+
+        //back for the service that takes the state: its require binds the service lua_service::init puts in the registry
+        moon::preload(L, "mooncore", luaopen_moon);
+        lua_settop(L, 0);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+        return ps;
+    }
+
+    //builds one state, true once the pool is full
+    bool fill_vm_pool(const std::string& name, router* r)
+    {
+        vm_pool& pool = vm_pools[name];
+        if (!pool.conf)
+        {
+            pool.conf = find_vm_pool_config(name);
+        }
+
+        if (pool.conf)
+        {
+            const auto& conf = *pool.conf;
+            if (pool.states.size() < conf.size && (conf.memlimit == 0 || pool.mem < conf.memlimit))
+            {
+                if (auto ps = make_pooled_state(name, conf, r); ps)
+                {
+                    pool.mem += ps->mem;
+                    pool.states.emplace_back(std::move(ps));
+                    return false;
+                }
+            }
+        }
+        pool.filling = false;
+        return true;
+    }
+
+    void start_fill_vm_pool(const std::string& name, worker* w, router* r)
+    {
+        vm_pool& pool = vm_pools[name];
+        if (!pool.filling)
+        {
+            pool.filling = true;
+            w->post_idle([name, r]() {
+                return fill_vm_pool(name, r);
+            });
+        }
+    }
+
+    std::unique_ptr<pooled_state> take_pooled_state(const std::string& name, worker* w, router* r)
+    {
+        vm_pool& pool = vm_pools[name];
+        std::unique_ptr<pooled_state> ps;
+        if (!pool.states.empty())
+        {
+            ps = std::move(pool.states.back());
+            pool.states.pop_back();
+            pool.mem -= ps->mem;
+        }
+        start_fill_vm_pool(name, w, r);
+        return ps;
+    }
+}
+
+bool lua_service::make_vm_pool(server* s, std::string name, size_t size, size_t memlimit, std::vector<std::string> modules)
+{
+    auto conf = std::make_shared<vm_pool_config>();
+    conf->size = size;
+    conf->memlimit = memlimit;
+    conf->modules = std::move(modules);
+    {
+        std::lock_guard lock(vm_pool_lock);
+        if (!vm_pool_configs.emplace(name, std::move(conf)).second)
+        {
+            return false;
+        }
+    }
+
+    router* r = s->get_router();
+    for (auto& w : s->get_workers())
+    {
+        asio::post(w->io_context(), [name, w = w.get(), r]() {
+            start_fill_vm_pool(name, w, r);
+        });
+    }
+    return true;
+}
+
 lua_service::lua_service()
-    : lua_(lua_newstate(lalloc, this))
 {
 
 }
 
 lua_service::~lua_service()
 {
+    if (arena_)
+    {
+        arena_->drop();
+    }
     logger()->logstring(true, moon::LogLevel::Info, moon::format("[WORKER %u] destroy service [%s] ", worker_->id(), name().data()), id());
 }
 
@@ -94,27 +310,65 @@ bool lua_service::init(std::string_view config)
         MOON_CHECK(!luafile.empty(), "lua service init failed: config does not provide lua file.");
         mem_limit = static_cast<size_t>(conf.get_value<int64_t>("memlimit"));
 
+        bool pooled = false;
+        if (auto pool = conf.get_value<std::string>("vmpool"); !pool.empty())
+        {
+            if (auto ps = take_pooled_state(pool, worker_, router_); ps)
+            {
+                lua_.reset(ps->L);
+                lua_setallocf(ps->L, lalloc, this);
+                mem = ps->mem;
+                pooled = true;
+            }
+        }
+
+        if (!pooled)
+        {
+            //a pooled state keeps its blocks in the global heap
+            if (conf.get_value<bool>("arena"))
+            {
+                arena_ = std::make_unique<arena>();
+            }
+            lua_.reset(lua_newstate(lalloc, this));
+            MOON_CHECK(lua_, "lua service init failed: new state failed.");
+        }
+
         lua_State* L = lua_.get();
         lua_gc(L, LUA_GCSTOP, 0);
-        lua_gc(L, LUA_GCGEN, 0, 0);
+        //idle gc steps an incremental collector, generational steps are whole minor collections
+        if (server_->idle_gc() > 0)
+        {
+            lua_gc(L, LUA_GCINC, 0, 0, 0);
+        }
+        else
+        {
+            lua_gc(L, LUA_GCGEN, 0, 0);
+        }
 
-        luaL_openlibs(L);
+        if (!pooled)
+        {
+            luaL_openlibs(L);
+        }
 
         lua_pushlightuserdata(L, this);
         lua_setfield(L, LUA_REGISTRYINDEX, LMOON_GLOBAL);
         lua_pushlightuserdata(L, &worker_->socket());
         lua_setfield(L, LUA_REGISTRYINDEX, LASIO_GLOBAL);
 
-        int r = luaL_dostring(L, router_->get_env("CPATH").data());
-        MOON_CHECK(r == LUA_OK, moon::format("CPATH %s", lua_tostring(L, -1)));
-        r = luaL_dostring(L, router_->get_env("PATH").data());
-        MOON_CHECK(r == LUA_OK, moon::format("PATH %s", lua_tostring(L, -1)));
+        if (!pooled)
+        {
+            int r = luaL_dostring(L, router_->get_env("CPATH").data());
+            MOON_CHECK(r == LUA_OK, moon::format("CPATH %s", lua_tostring(L, -1)));
+            r = luaL_dostring(L, router_->get_env("PATH").data());
+            MOON_CHECK(r == LUA_OK, moon::format("PATH %s", lua_tostring(L, -1)));
+
+            open_custom_libraries(L);
+        }
 
-        open_custom_libraries(L);
         lua_pushcfunction(L, traceback);
         assert(lua_gettop(L) == 1);
 
-        r = luaL_loadfile(L, luafile.data());
+        int r = luaL_loadfile(L, luafile.data());
         MOON_CHECK(r == LUA_OK, moon::format("loadfile %s", lua_tostring(L, -1)));
         lua_json_decode(L, config.data(), config.size());//push table
         assert(lua_type(L, -1) == LUA_TTABLE);
@@ -139,11 +393,63 @@ bool lua_service::init(std::string_view config)
     return ok_;
 }
 
+void lua_service::on_migrate()
+{
+    lua_State* L = lua_.get();
+    lua_pushlightuserdata(L, &worker_->socket());
+    lua_setfield(L, LUA_REGISTRYINDEX, LASIO_GLOBAL);
+}
+
+bool lua_service::gc_step()
+{
+    if (!ok())
+    {
+        return false;
+    }
+
+    //a new cycle starts once the heap grew by a quarter since the last one finished
+    if (!gc_cycle_ && mem <= gc_mem_ + gc_mem_ / 4)
+    {
+        return false;
+    }
+
+    lua_State* L = lua_.get();
+    if (!lua_gc(L, LUA_GCISRUNNING))
+    {
+        return false;
+    }
+
+    gc_cycle_ = (0 == lua_gc(L, LUA_GCSTEP, 0));
+    if (!gc_cycle_)
+    {
+        gc_mem_ = mem;
+    }
+    return true;
+}
+
+void lua_service::publish_registry_version(lua_State* L)
+{
+    uint64_t v = router_->registry_version();
+    if (v == registry_version_)
+    {
+        return;
+    }
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, registry_state_key()) == LUA_TTABLE)
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(v));
+        lua_setfield(L, -2, "version");
+        registry_version_ = v;
+    }
+    lua_pop(L, 1);
+}
+
 void lua_service::dispatch(message *msg)
 {
     if (!ok())
         return;
     lua_State* L = lua_.get();
+    publish_registry_version(L);
     try
     {
         int trace = 1;
@@ -167,31 +473,78 @@ void lua_service::dispatch(message *msg)
             return;
         }
 
-        std::string error;
-
-        switch (r) {
-        case LUA_ERRRUN:
-            error = moon::format("dispatch %s error:\n%s", name().data(), lua_tostring(L, -1));
-            break;
-        case LUA_ERRMEM:
-            error = moon::format("dispatch %s memory error", name().data());
-            break;
-        case LUA_ERRERR:
-            error = moon::format("dispatch %s error in error", name().data());
-            break;
-        };
-
+        dispatch_error(r, msg);
+    }
+    catch (const std::exception& e)
+    {
+        luaL_traceback(L, L, e.what(), 1);
+        const char* trace = lua_tostring(L, -1);
+        if (nullptr == trace)
+        {
+            trace = "";
+        }
+        CONSOLE_ERROR(logger(), "dispatch:\n%s", trace);
         lua_pop(L, 1);
+    }
+}
 
-        if (msg->sessionid() >= 0)
+void lua_service::dispatch_batch(moon::message_ptr_t* msgs, size_t count)
+{
+    if (!ok())
+        return;
+    lua_State* L = lua_.get();
+    publish_registry_version(L);
+    try
+    {
+        int trace = 1;
+        int top = lua_gettop(L);
+        if (top == 0)
         {
-            logger()->logstring(true, moon::LogLevel::Error, error, id());
+            lua_pushcfunction(L, traceback);
+            lua_rawgetp(L, LUA_REGISTRYINDEX, this);
         }
         else
         {
-            msg->set_sessionid(-msg->sessionid());
-            router_->response(msg->sender(), "dispatch "sv, error, msg->sessionid(), PTYPE_ERROR);
+            assert(top == 2);
+        }
+
+        lua_rawgetp(L, LUA_REGISTRYINDEX, batch_callback_key());
+        lua_rawgetp(L, LUA_REGISTRYINDEX, batch_array_key());
+        int fn = 3;
+        int arr = 4;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            lua_pushlightuserdata(L, msgs[i].get());
+            lua_rawseti(L, arr, static_cast<lua_Integer>(2 * i + 1));
+            lua_pushinteger(L, msgs[i]->type());
+            lua_rawseti(L, arr, static_cast<lua_Integer>(2 * i + 2));
+        }
+
+        //an error only skips the failed message, continue with the next one
+        size_t first = 1;
+        while (first <= count)
+        {
+            lua_pushvalue(L, fn);
+            lua_pushvalue(L, arr);
+            lua_pushinteger(L, static_cast<lua_Integer>(first));
+            lua_pushinteger(L, static_cast<lua_Integer>(count));
+            int r = lua_pcall(L, 3, 0, trace);
+            if (r == LUA_OK) {
+                break;
+            }
+
+            lua_rawgeti(L, arr, 0);
+            size_t failed = static_cast<size_t>(lua_tointeger(L, -1));
+            lua_pop(L, 1);
+            if (failed < first || failed > count)
+            {
+                failed = first;
+            }
+            dispatch_error(r, msgs[failed - 1].get());
+            first = failed + 1;
         }
+        lua_settop(L, 2);
     }
     catch (const std::exception& e)
     {
@@ -201,8 +554,37 @@ void lua_service::dispatch(message *msg)
         {
             trace = "";
         }
-        CONSOLE_ERROR(logger(), "dispatch:\n%s", trace);
-        lua_pop(L, 1);
+        CONSOLE_ERROR(logger(), "dispatch_batch:\n%s", trace);
+        lua_settop(L, 2);
     }
 }
 
+void lua_service::dispatch_error(int r, message* msg)
+{
+    lua_State* L = lua_.get();
+    std::string error;
+
+    switch (r) {
+    case LUA_ERRRUN:
+        error = moon::format("dispatch %s error:\n%s", name().data(), lua_tostring(L, -1));
+        break;
+    case LUA_ERRMEM:
+        error = moon::format("dispatch %s memory error", name().data());
+        break;
+    case LUA_ERRERR:
+        error = moon::format("dispatch %s error in error", name().data());
+        break;
+    };
+
+    lua_pop(L, 1);
+
+    if (msg->sessionid() >= 0)
+    {
+        logger()->logstring(true, moon::LogLevel::Error, error, id());
+    }
+    else
+    {
+        msg->set_sessionid(-msg->sessionid());
+        router_->response(msg->sender(), "dispatch "sv, error, msg->sessionid(), PTYPE_ERROR);
+    }
+}
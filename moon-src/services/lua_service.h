@@ -2,6 +2,7 @@
 #include "lua.hpp"
 #include "common/log.hpp"
 #include "common/buffer.hpp"
+#include "common/arena.hpp"
 #include "service.hpp"
 
 #define LMOON_GLOBAL "LMOON_GLOBAL"
@@ -18,16 +19,50 @@ public:
     lua_service();
 
     ~lua_service();
+
+    //registry keys of the batch dispatch function and the array it receives messages in
+    static const void* batch_callback_key() { static const char key = 0; return &key; }
+
+    static const void* batch_array_key() { static const char key = 0; return &key; }
+
+    //registry key of the table moon.lua reads the registry version from
+    static const void* registry_state_key() { static const char key = 0; return &key; }
+
+    //declare a pool of pre-initialized states, taken by services created with config "vmpool": name.
+    //size and memlimit bound the idle states of each worker, false if the name is already used
+    static bool make_vm_pool(moon::server* s, std::string name, size_t size, size_t memlimit, std::vector<std::string> modules);
+
+    //bytes the service's arena took from the system, 0 without arena
+    size_t reserved_memory() const { return arena_ ? arena_->reserved() : 0; }
 private:
     bool init(std::string_view config) override;
 
     void dispatch(moon::message* msg) override;
 
+    void dispatch_batch(moon::message_ptr_t* msgs, size_t count) override;
+
+    void dispatch_error(int r, moon::message* msg);
+
+    void on_migrate() override;
+
+    //copy a changed router registry version to the lua side, before a message is handled
+    void publish_registry_version(lua_State* L);
+
+    bool gc_step() override;
+
     static void* lalloc(void * ud, void *ptr, size_t osize, size_t nsize);
 public:
     size_t mem = 0;
     size_t mem_limit = 0;
     size_t mem_report = 8 * 1024 * 1024;
 private:
+    //mem when the last idle gc cycle finished
+    size_t gc_mem_ = 0;
+    //an idle gc cycle is in progress
+    bool gc_cycle_ = false;
+    //registry version last copied to the lua side
+    uint64_t registry_version_ = 0;
+    //declared before lua_: the state is closed first
+    std::unique_ptr<moon::arena> arena_;
     std::unique_ptr<lua_State, state_deleter> lua_;
 };
\ No newline at end of file
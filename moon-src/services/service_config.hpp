@@ -1,6 +1,7 @@
 #pragma once
 #include "config.hpp"
 #include "common/string.hpp"
+#include "common/hash.hpp"
 #include "common/exception.hpp"
 #include "rapidjson/document.h"
 #include "common/rapidjson_helper.hpp"
@@ -22,6 +23,26 @@ namespace moon
             }
 
             s->set_name(rapidjson::get_value<std::string>(&doc, "name"));
+
+            if (auto capacity = rapidjson::get_value<uint32_t>(&doc, "mailbox_limit"); capacity > 0)
+            {
+                auto policy = rapidjson::get_value<std::string>(&doc, "mailbox_policy", "reject");
+                switch (moon::chash_string(policy))
+                {
+                case "reject"_csh:
+                    s->set_mailbox_limit(capacity, mailbox_policy::reject);
+                    break;
+                case "drop_oldest"_csh:
+                    s->set_mailbox_limit(capacity, mailbox_policy::drop_oldest);
+                    break;
+                case "backpressure"_csh:
+                    s->set_mailbox_limit(capacity, mailbox_policy::backpressure);
+                    break;
+                default:
+                    CONSOLE_ERROR(s->logger(), "service %s unknown mailbox_policy '%s'", s->name().data(), policy.data());
+                    return false;
+                }
+            }
             return true;
         }
 
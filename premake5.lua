@@ -1,3 +1,8 @@
+newoption {
+    trigger = "io_uring",
+    description = "Build the io_uring network backend (linux), enabled by \"io_uring\": true in the server config"
+}
+
 workspace "Server"
     configurations { "Debug", "Release" }
     flags{"NoPCH","RelativeLinks"}
@@ -78,6 +83,8 @@ project "moon"
     filter {"system:linux"}
         links{"dl","pthread","stdc++fs"}
         linkoptions {"-static-libstdc++ -static-libgcc", "-Wl,-rpath=./","-Wl,--as-needed"}
+    filter {"system:linux", "options:io_uring"}
+        defines {"MOON_ENABLE_IO_URING"}
     filter {"system:macosx"}
         links{"dl","pthread"}
         linkoptions {"-Wl,-rpath,./"}
@@ -159,3 +166,38 @@ add_lua_module("./third/sharetable", "sharetable")
 
 -------------------------clonefunc: for hotfix--------------------
 add_lua_module("./third/lclonefunc", "clonefunc")
+
+-----------------------------------------------------------------------------------
+--[[
+    基准测试: ./benchmark/<name>.cpp, 每个文件生成一个可执行程序
+    运行: ./build/bin/Release/<name>
+    需要完整运行时的基准测试是lua脚本, 运行: ./moon -f benchmark/<name>.lua
+]]
+local function add_benchmark(name, uselua)
+    project(name)
+        location("build/projects/%{prj.name}")
+        objdir "build/obj/%{prj.name}/%{cfg.buildcfg}"
+        targetdir "build/bin/%{cfg.buildcfg}"
+
+        kind "ConsoleApp"
+        language "C++"
+        includedirs {"./","./moon-src","./moon-src/core","./third","./third/lua54"}
+        files {"./benchmark/"..name..".cpp"}
+        defines {"ASIO_STANDALONE", "ASIO_NO_DEPRECATED"}
+        if uselua then
+            links {"lua54"}
+        end
+        filter {"system:linux"}
+            links{"pthread"}
+            if uselua then
+                links{"dl"}
+            end
+end
+
+add_benchmark("timer_benchmark")
+add_benchmark("broadcast_benchmark")
+add_benchmark("precise_timer_benchmark")
+add_benchmark("service_lookup_benchmark")
+add_benchmark("arena_benchmark", true)
+add_benchmark("ws_mask_benchmark")
+add_benchmark("mailbox_queue_benchmark")
@@ -1195,6 +1195,47 @@ static int cache_mode(lua_State *L) {
 	return 0;
 }
 
+/* module name + search path -> file, lets 'require' skip probing the path */
+static int search_key = 0;
+
+LUALIB_API const char *
+luaL_loadsearchcache(lua_State *L, const char *key) {
+  const char *result = NULL;
+  if (cache_level(L) == CACHE_OFF || CC.L == NULL)
+    return NULL;
+  SPIN_LOCK(&CC)
+    lua_State *cL = CC.L;
+    if (lua_rawgetp(cL, LUA_REGISTRYINDEX, &search_key) == LUA_TTABLE) {
+      if (lua_getfield(cL, -1, key) == LUA_TSTRING)
+        result = lua_pushstring(L, lua_tostring(cL, -1));
+      lua_pop(cL, 1);
+    }
+    lua_pop(cL, 1);
+  SPIN_UNLOCK(&CC)
+  return result;
+}
+
+LUALIB_API void
+luaL_savesearchcache(lua_State *L, const char *key, const char *filename) {
+  if (cache_level(L) != CACHE_ON)
+    return;
+  SPIN_LOCK(&CC)
+    if (CC.L == NULL) {
+      init();
+    }
+    lua_State *cL = CC.L;
+    if (lua_rawgetp(cL, LUA_REGISTRYINDEX, &search_key) != LUA_TTABLE) {
+      lua_pop(cL, 1);
+      lua_newtable(cL);
+      lua_pushvalue(cL, -1);
+      lua_rawsetp(cL, LUA_REGISTRYINDEX, &search_key);
+    }
+    lua_pushstring(cL, filename);
+    lua_setfield(cL, -2, key);
+    lua_pop(cL, 1);
+  SPIN_UNLOCK(&CC)
+}
+
 LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
                                              const char *mode) {
   int level = cache_level(L);
@@ -543,8 +543,22 @@ static int checkload (lua_State *L, int stat, const char *filename) {
 static int searcher_Lua (lua_State *L) {
   const char *filename;
   const char *name = luaL_checkstring(L, 1);
+#if defined(LUA_CACHELIB)
+  const char *key;
+  const char *path;
+  lua_getfield(L, lua_upvalueindex(1), "path");
+  path = lua_tostring(L, -1);
+  key = lua_pushfstring(L, "%s\n%s", name, path ? path : "");
+  filename = luaL_loadsearchcache(L, key);
+  if (filename != NULL)
+    return checkload(L, (luaL_loadfile(L, filename) == LUA_OK), filename);
+  filename = findfile(L, name, "path", LUA_LSUBSEP);
+  if (filename == NULL) return 1;  /* module not found in this path */
+  luaL_savesearchcache(L, key, filename);
+#else
   filename = findfile(L, name, "path", LUA_LSUBSEP);
   if (filename == NULL) return 1;  /* module not found in this path */
+#endif
   return checkload(L, (luaL_loadfile(L, filename) == LUA_OK), filename);
 }
 
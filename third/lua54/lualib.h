@@ -47,6 +47,8 @@ LUAMOD_API int (luaopen_package) (lua_State *L);
 #define LUA_CACHELIB
 LUAMOD_API int (luaopen_cache) (lua_State *L);
 LUALIB_API void (luaL_initcodecache) (void);
+LUALIB_API const char *(luaL_loadsearchcache) (lua_State *L, const char *key);
+LUALIB_API void (luaL_savesearchcache) (lua_State *L, const char *key, const char *filename);
 
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);